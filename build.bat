@@ -1,8 +1,18 @@
 @echo off
 
+rem Usage: build.bat [embed OPTIONS...]
+rem
+rem With 'embed', the freshly built overhead_debug.exe is run with
+rem --emit-assets and the given OPTIONS (for example:
+rem     build.bat embed --background=back.png --overlay=over.png
+rem ) to analyze the images at build time. The results are written to
+rem overhead_assets.h and compiled into overhead_kiosk.exe, which does not
+rem load any image files at run time.
+
 rem Compiler options used:
 rem     /nologo ... do not display Microsoft startup banner
 rem     /Dxxx ... define preprocessor macros
+rem         /DOVERHEAD_EMBEDDED_ASSETS ... use the tables in overhead_assets.h instead of image files
 rem     /EHa-s-c- ... turn off all exception handling
 rem     /MT ... link to static run-time library
 rem     /O1 ... optimize for small code size
@@ -15,10 +25,22 @@ rem     /DEBUG:NONE ... don't generate debug info
 rem     /OUT:filename ... specifies the output file to create
 rem     /INCREMENTAL:NO ... do not link incrementally
 rem     /SUBSYSTEM:WINDOWS ... mark this as a Windows GUI application
+rem     /SUBSYSTEM:CONSOLE ... mark this as a console application
 
 set CXX_FLAGS=/nologo /DWIN32 /D_WINDOWS /W3 /EHa-s-c- /MT
-set LINK_LIBRARIES=kernel32.lib user32.lib gdi32.lib
+set LINK_LIBRARIES=kernel32.lib user32.lib gdi32.lib psapi.lib
 
 cl %CXX_FLAGS% /Zi overhead.cpp %LINK_LIBRARIES% /link /DEBUG:FULL /INCREMENTAL:NO /SUBSYSTEM:WINDOWS /OUT:overhead_debug.exe
 
 cl %CXX_FLAGS% /O1 overhead.cpp %LINK_LIBRARIES% /link /DEBUG:NONE /INCREMENTAL:NO /SUBSYSTEM:WINDOWS /OUT:overhead.exe
+
+cl %CXX_FLAGS% /O1 overhead_shm_reader.cpp kernel32.lib /link /DEBUG:NONE /INCREMENTAL:NO /SUBSYSTEM:CONSOLE /OUT:overhead_shm_reader.exe
+
+if /I not "%1"=="embed" goto :eof
+
+set EMBED_OPTIONS=%*
+set EMBED_OPTIONS=%EMBED_OPTIONS:*embed=%
+overhead_debug.exe --emit-assets=overhead_assets.h %EMBED_OPTIONS%
+if errorlevel 1 exit /b 1
+
+cl %CXX_FLAGS% /O1 /DOVERHEAD_EMBEDDED_ASSETS overhead.cpp %LINK_LIBRARIES% /link /DEBUG:NONE /INCREMENTAL:NO /SUBSYSTEM:WINDOWS /OUT:overhead_kiosk.exe
@@ -5,3 +5,4 @@ del /Q *.ilk
 del /Q *.obj
 del /Q *.dump
 del /Q tags
+del /Q overhead_assets.h
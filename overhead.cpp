@@ -23,9 +23,16 @@
 
 namespace {
     constexpr char *g_usage = 
-        "Usage: overhead [X [Y [W [H]]]] [--countdown=MINUTES] [--background=BACKGROUND_IMAGE] [--overlay=OVERLAY_IMAGE]\n"
+        "Usage: overhead [X [Y [W [H]]]] [--countdown=MINUTES] [--control[=PIPE_NAME]]\n"
+        "                [--background=BACKGROUND_IMAGE [--watch]] [--overlay=OVERLAY_IMAGE[@X,Y]]...\n"
+        "                [--scale=FACTOR | --target-size=WxH] [--tolerance=PIXELS]\n"
+        "                [--exclude=X,Y,W,H]... [--shm[=NAME]]\n"
+        "                [--soak=FRAMES [--soak-step=MS] [--soak-realtime]]\n"
+        "                [--analyze=DIRECTORY_OR_LIST_FILE [--analyze-output=FILE]]\n"
+        "                [--emit-assets=HEADER_FILE]\n"
         "\n"
-        "Note: W and H are ignored if you specify a BACKGROUND_IMAGE.\n";
+        "Note: W and H are ignored if you specify a BACKGROUND_IMAGE.\n"
+        "      --overlay and --exclude can be given multiple times.\n";
 }
 
 /*
@@ -39,6 +46,11 @@ namespace {
        from this image. IMAGE is expected to be an RGB image without alpha
        channel.
 
+    *) --watch ... reloads the --background IMAGE whenever the file
+       changes, so you can edit it while the timer is running. The new
+       image must have the same size as the one loaded at startup;
+       otherwise it is ignored.
+
     *) --overlay=IMAGE ... This option expects IMAGE to be in RGBA format.
        It analyzes the alpha channel of the given image and finds its
        transparent regions (defined by alpha < 255). It then displays
@@ -56,6 +68,115 @@ namespace {
        (This is to avoid reliance on the compositing window manager
        as mentioned above.)
 
+    *) --overlay=IMAGE@X,Y ... Same as above but the marker lines are
+       shifted by (X, Y) screen pixels. You can give --overlay several
+       times (with or without offsets), for example to show the outlines
+       of a separate overlay on each of your monitors from a single
+       'overhead' process. All overlays are analyzed in parallel and
+       their marker lines are merged into a single set of windows. Each
+       overlay is clipped to the monitor that shows most of it, so no
+       marker lines are created for parts that are off the screen.
+
+       If an overlay IMAGE is an animated GIF, the marker lines of all its
+       frames are determined up front (in parallel). During playback only
+       the marker windows that differ from the previous frame are moved,
+       resized, shown or hidden. (Animated PNGs are not supported by
+       stb_image; only their default image is used.)
+
+    *) --scale=FACTOR ... resamples the transparency of all overlay
+       images by FACTOR (a decimal number like 0.5) before determining the
+       marker lines, for example if you use a 4K overlay on a 1080p canvas
+       or if the display uses DPI scaling. The resampling is conservative:
+       a pixel of the resampled mask counts as transparent if any of the
+       image pixels it covers is transparent.
+
+    *) --target-size=WxH ... like --scale but resamples all overlay images
+       to exactly W x H pixels.
+
+    *) --exclude=X,Y,W,H ... removes the given screen rectangle from the
+       transparent areas of all overlays before the marker lines are
+       determined, so that the marker lines run just outside of it. Use
+       this for areas that are covered anyway, like the Windows task bar
+       (see Limitations). --exclude can be given multiple times.
+
+    *) --shm[=NAME] ... additionally publishes every rendered frame of the
+       timer window into the shared memory file mapping Local\NAME
+       (default: Local\overhead_frames) together with the marker rectangles
+       of all static overlays. A local compositor can read the frames from
+       there without capturing the screen. See overhead_shm.h for the layout
+       and overhead_shm_reader.cpp for a simple reader.
+
+    *) --tolerance=PIXELS ... simplifies the outlines of all overlays so
+       that rounded corners and anti-aliased edges do not turn into long
+       staircases of tiny marker windows. Each vertical marker line is
+       straightened as long as the edge it follows stays within PIXELS
+       pixels. Marker lines stay outside the transparent area and are at
+       most PIXELS pixels away from it. If you start the program from a
+       command prompt, it prints how many marker rectangles this saved.
+
+    *) --control[=PIPE_NAME] ... listens on the named pipe
+       \\.\pipe\PIPE_NAME (default: \\.\pipe\overhead) for commands
+       that change the timer while the program is running. This also
+       shows the timer window if you did not specify --countdown.
+       Commands are lines of text (several commands can be sent at once,
+       separated by newlines). DURATION is either MINUTES or MINUTES:SECONDS.
+
+           set DURATION ... count down from DURATION
+           add DURATION ... add DURATION to the displayed time
+           sub DURATION ... subtract DURATION from the displayed time
+           pause        ... stop the clock
+           resume       ... continue a paused clock
+           reset        ... restart the countdown given by --countdown
+           up           ... count up from the displayed time
+
+       For example, from a command prompt:
+
+           echo add 0:30 > \\.\pipe\overhead
+
+    Testing
+    -------
+
+    *) --soak=FRAMES ... does not create any windows but renders FRAMES
+       frames of the timer (including --shm output, if requested) as fast
+       as possible, driven by a simulated clock that advances by MS
+       milliseconds per frame (--soak-step=MS, default 1000). With
+       --soak-realtime, frames are paced to follow the wall clock instead.
+       The program prints frame latency percentiles, the number of heap
+       allocations per frame (made by this program and stb_image; GDI and
+       the C run-time library are only covered by the heap snapshots) and
+       the growth of heap blocks, private memory and handle counts, and
+       exits with a failure code if there were any allocations or if any
+       of the counts grew after the warm-up frames.
+       Without --countdown, the simulated clock counts up. With
+       --countdown, the countdown restarts whenever it expires.
+
+    *) --analyze=DIRECTORY_OR_LIST_FILE ... does not create any windows
+       but analyzes many overlay images in parallel (using all processors)
+       and writes the results to FILE (--analyze-output=FILE) or to the
+       console. The images are either all *.png and *.gif files in the
+       given DIRECTORY or the files listed in LIST_FILE (one per line;
+       empty lines and lines starting with '#' are ignored). --scale,
+       --target-size, --tolerance and --exclude (relative to the image)
+       apply. The output is plain text
+       (E is the number of marker rectangles saved by --tolerance):
+
+           image "FILE" WxH frames N decode_us D analyze_us A
+           frame F regions R markers M eliminated E
+           X Y W H                      (M lines, one per marker rectangle)
+           ...
+           error "FILE" MESSAGE         (for images that failed to load)
+
+       The exit code signals failure if any image could not be analyzed.
+
+    *) --emit-assets=HEADER_FILE ... loads the background image and the
+       (static) overlays given by the other options, determines the marker
+       lines and writes the results as constant C++ tables to HEADER_FILE.
+       If you compile overhead.cpp with OVERHEAD_EMBEDDED_ASSETS defined,
+       it includes "overhead_assets.h" and uses these tables instead of
+       loading any image files, so it starts without file I/O, image
+       decoding or heap allocations for the assets. 'build.bat embed ...'
+       does all of this for you and builds overhead_kiosk.exe.
+
     Limitations
     -----------
 
@@ -63,8 +184,8 @@ namespace {
     windows. However, it may loose the fight against the Windows task bar
     which also draws itself over all other windows. Therefore you should
     avoid putting your countdown timer in the area covered by the Windows
-    task bar. Please tell me if you find a simple way to remove this
-    limitation.
+    task bar (--exclude keeps the marker lines out of it). Please tell me
+    if you find a simple way to remove this limitation.
  */
 
 /*
@@ -107,17 +228,54 @@ the stb_image library see the end of the file
 #include <cinttypes>
 #include <cctype>
 
+// all heap allocations of this program and stb_image are counted (see --soak)
+namespace {
+    void *counted_malloc(size_t size);
+    void *counted_calloc(size_t count, size_t size);
+    void *counted_realloc(void *block, size_t size);
+}
+#define STBI_MALLOC(size) counted_malloc(size)
+#define STBI_REALLOC(block, size) counted_realloc(block, size)
+#define STBI_FREE(block) free(block)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "third_party/stb_image.h"
 
+#include "overhead_shm.h"
+
+#ifdef OVERHEAD_EMBEDDED_ASSETS
+#include "overhead_assets.h" // generated with --emit-assets, see build.bat
+#endif
+
 //#define UNICODE
 #include <windows.h>
 
 //#define DEBUG_MEMORY_USE
 
-#ifdef DEBUG_MEMORY_USE
 #include <psapi.h>
-#endif
+
+// all allocations of this program go through these functions (see --soak)
+namespace {
+    volatile LONG64 g_n_allocations = 0;
+
+    void *counted_malloc(size_t size)
+    {
+        (void)::InterlockedIncrement64(&g_n_allocations);
+        return malloc(size);
+    }
+
+    void *counted_calloc(size_t count, size_t size)
+    {
+        (void)::InterlockedIncrement64(&g_n_allocations);
+        return calloc(count, size);
+    }
+
+    void *counted_realloc(void *block, size_t size)
+    {
+        (void)::InterlockedIncrement64(&g_n_allocations);
+        return realloc(block, size);
+    }
+}
 
 namespace {
     HWND g_main_window = NULL;
@@ -173,6 +331,23 @@ namespace {
                     SWP_NOMOVE | SWP_NOSIZE);
     }
 
+    /**
+     * Use the console of the parent process if there is one (for example if
+     * we are run from a command prompt), otherwise open our own console.
+     *
+     * \return true if we attached to the parent's console.
+     */
+    bool attach_console()
+    {
+        if (!::AttachConsole(ATTACH_PARENT_PROCESS)) {
+            open_console_window();
+            return false;
+        }
+        freopen_s((FILE**)stdout, "CONOUT$", "w", stdout);
+        freopen_s((FILE**)stderr, "CONOUT$", "w", stderr);
+        return true;
+    }
+
     void prompt_for_console_key_press()
     {
         fflush(stderr);
@@ -257,7 +432,30 @@ namespace {
 
 namespace {
     int g_countdown_minutes = 0;
-    SYSTEMTIME g_expiry_time = { 0 };
+    bool g_show_clock = false; // set in parse_command_line
+    CHAR *g_control_pipe_name = nullptr;
+    CHAR *g_shm_name = nullptr;
+
+    enum ClockMode {
+        CLOCK_COUNT_DOWN,
+        CLOCK_COUNT_UP,
+    };
+
+    // headless soak test (see --soak)
+    int64_t g_soak_frames = 0;
+    int64_t g_soak_step_ms = 1000;
+    bool g_soak_realtime = false;
+
+    // when set, the clock is driven by g_simulated_clock_ms instead of the real clock
+    bool g_use_simulated_clock = false;
+    int64_t g_simulated_clock_ms = 0;
+
+    // the displayed time is g_clock_value_ms at tick g_clock_reference_ms and
+    // changes from there with the clock mode unless the clock is paused
+    ClockMode g_clock_mode = CLOCK_COUNT_DOWN;
+    bool g_clock_paused = false;
+    int64_t g_clock_value_ms = 0;
+    int64_t g_clock_reference_ms = 0;
     HFONT g_font = NULL;
     int g_position_x = 0;
     int g_position_y = 0;
@@ -267,7 +465,62 @@ namespace {
     uint8_t *g_background_image_data = nullptr;
     BITMAPINFO g_background_image_info = { 0 };
 
-    CHAR *g_overlay_image_filename = nullptr;
+    struct OverlaySpec {
+        CHAR *filename;
+        int offset_x;
+        int offset_y;
+    };
+
+    struct OverlaySpecArray {
+        OverlaySpec *array;
+        int n_allocated;
+        int n_used;
+    };
+
+    OverlaySpecArray g_overlays;
+
+    CHAR *g_emit_assets_filename = nullptr;
+
+    // batch analysis (see --analyze)
+    CHAR *g_analyze_path = nullptr;
+    CHAR *g_analyze_output_filename = nullptr;
+
+    // outline simplification tolerance in pixels (0 means no simplification)
+    int g_outline_tolerance = 0;
+    int g_n_eliminated_markers = 0; // over all frames of all overlays
+
+    // overlay resampling (0 means no resampling)
+    double g_overlay_scale = 0;
+    int g_overlay_target_width = 0;
+    int g_overlay_target_height = 0;
+
+    // half-open range [start; end) of pixels in a row
+    struct Span {
+        int start;
+        int end;
+    };
+
+    /**
+     * A set of pixels stored as a list of spans per row. The spans of a row
+     * are sorted, non-empty and neither overlap nor touch, so every set has
+     * exactly one representation. Only rows y0 to y0 + height - 1 are stored;
+     * all other rows are empty. The spans of row y0 + i are
+     * spans[row_starts[i]] to spans[row_starts[i + 1] - 1].
+     *
+     * For big but simple masks this is much smaller than a TransparencyMask
+     * and all operations take time proportional to the number of spans.
+     */
+    struct SpanRegion {
+        int y0;
+        int height;
+        int *row_starts; // height + 1 entries
+        Span *spans;
+        int n_spans;
+        int n_allocated;
+    };
+
+    // screen area in which no marker lines are drawn (see --exclude)
+    SpanRegion g_exclusion;
 
     struct MarkerWindow {
         HWND window;
@@ -285,20 +538,47 @@ namespace {
 
     MarkerWindowArray g_marker_windows;
 
-    void load_background_image()
-    {
-        char *filename = g_background_image_filename;
-        if (!filename)
-            return;
-        int image_width;
-        int image_height;
-        int image_n_components;
-        unsigned char *data = stbi_load(filename, &image_width, &image_height, &image_n_components, 0);
-        if (!data)
-            exit_error("could not load image from file '%s'\n", filename);
-        if (image_n_components != 3)
-            exit_error("unexpected number of components in image '%s' (is %d; expected 3)\n", filename, image_n_components);
+    // change of a single marker window between consecutive animation frames
+    struct MarkerDelta {
+        int index; // into AnimatedOverlay::windows
+        int x;
+        int y;
+        int w; // 0 means the window is hidden
+        int h;
+    };
+
+    struct AnimationFrame {
+        MarkerWindowArray markers; // in screen coordinates
+        int n_regions; // number of transparent regions
+        int n_eliminated; // number of marker rectangles saved by outline simplification
+        int delay_ms;
+        MarkerDelta *deltas; // changes to get from this frame to the next one
+        int n_deltas;
+        int *matches; // for every marker of the next frame, the index of the identical marker in this frame or -1
+    };
+
+    struct AnimatedOverlay {
+        AnimationFrame *frames;
+        int n_frames;
+        int current_frame;
+        int64_t next_frame_ms;
+        HWND *windows; // enough for the frame with the most markers
+        int n_windows;
+    };
+
+    AnimatedOverlay *g_animations = nullptr;
+    int g_n_animations = 0;
+
+    // one-shot waitable timers driving the clock and the animations (see create_timers)
+    HANDLE g_clock_timer = NULL;
+    HANDLE g_animation_timer = NULL;
 
+    // reload the background image when it changes on disk (see --watch)
+    bool g_watch_background = false;
+    FILETIME g_background_image_write_time;
+
+    void set_background_image_size(int image_width, int image_height)
+    {
         g_background_image_width = image_width;
         g_background_image_height = image_height;
         g_background_image_info.bmiHeader.biSize = sizeof(g_background_image_info);
@@ -312,294 +592,1693 @@ namespace {
         g_background_image_info.bmiHeader.biYPelsPerMeter = 0;
         g_background_image_info.bmiHeader.biClrUsed = 0;
         g_background_image_info.bmiHeader.biClrImportant = 0;
+    }
 
-        // rearrange bitmap data for consumption by the GDI in a slow and straight-forward way
+    // scanlines of 24-bit DIBs are padded to multiples of 4 bytes
+    uint32_t get_background_image_scanline_size(int image_width)
+    {
         uint32_t unaligned_scanline_size = image_width * 3;
-        uint32_t aligned_scanline_size = ((unaligned_scanline_size + 3) / 4) * 4;
-        uint32_t aligned_size = aligned_scanline_size * image_height;
-        g_background_image_data = (uint8_t*)malloc(aligned_size);
-        if (!g_background_image_data)
+        return ((unaligned_scanline_size + 3) / 4) * 4;
+    }
+
+    /**
+     * Load the image in filename and convert it to the layout expected by
+     * g_background_image_info.
+     *
+     * \return nullptr on success, otherwise an error message. On success,
+     *         *bitmap_data must be freed by the caller.
+     */
+    const char *decode_background_image(char *filename, uint8_t **bitmap_data, int *image_width, int *image_height)
+    {
+        int image_n_components;
+        unsigned char *data = stbi_load(filename, image_width, image_height, &image_n_components, 0);
+        if (!data)
+            return "could not load image";
+        if (image_n_components != 3) {
+            stbi_image_free(data);
+            return "unexpected number of components (expected 3)";
+        }
+
+        // rearrange bitmap data for consumption by the GDI in a slow and straight-forward way
+        uint32_t unaligned_scanline_size = *image_width * 3;
+        uint32_t aligned_scanline_size = get_background_image_scanline_size(*image_width);
+        uint32_t aligned_size = aligned_scanline_size * *image_height;
+        uint8_t *bitmap = (uint8_t*)counted_malloc(aligned_size);
+        if (!bitmap)
             exit_error("out of memory: could not allocate memory for background bitmap");
-        for (uint32_t y = 0; y < (uint32_t)image_height; ++y)
-            for (uint32_t x = 0; x < (uint32_t)image_width; ++x) {
-                g_background_image_data[aligned_scanline_size * y + 3*x + 0] = data[unaligned_scanline_size * y + 3*x + 2];
-                g_background_image_data[aligned_scanline_size * y + 3*x + 1] = data[unaligned_scanline_size * y + 3*x + 1];
-                g_background_image_data[aligned_scanline_size * y + 3*x + 2] = data[unaligned_scanline_size * y + 3*x + 0];
+        for (uint32_t y = 0; y < (uint32_t)*image_height; ++y)
+            for (uint32_t x = 0; x < (uint32_t)*image_width; ++x) {
+                bitmap[aligned_scanline_size * y + 3*x + 0] = data[unaligned_scanline_size * y + 3*x + 2];
+                bitmap[aligned_scanline_size * y + 3*x + 1] = data[unaligned_scanline_size * y + 3*x + 1];
+                bitmap[aligned_scanline_size * y + 3*x + 2] = data[unaligned_scanline_size * y + 3*x + 0];
             }
         stbi_image_free(data);
+        *bitmap_data = bitmap;
+        return nullptr;
+    }
+
+    /**
+     * \return false if the last write time of the file cannot be determined.
+     */
+    bool get_file_write_time(char *filename, FILETIME *write_time)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (!::GetFileAttributesEx(filename, GetFileExInfoStandard, &attributes))
+            return false;
+        *write_time = attributes.ftLastWriteTime;
+        return true;
+    }
+
+    void load_background_image()
+    {
+        char *filename = g_background_image_filename;
+        if (!filename)
+            return;
+        // take the time stamp first so that --watch does not miss a change during loading
+        if (!get_file_write_time(filename, &g_background_image_write_time))
+            memset(&g_background_image_write_time, 0, sizeof(g_background_image_write_time));
+        int image_width;
+        int image_height;
+        const char *error = decode_background_image(filename, &g_background_image_data, &image_width, &image_height);
+        if (error)
+            exit_error("%s: '%s'\n", error, filename);
+        set_background_image_size(image_width, image_height);
         // XXX @Leak currently leaking g_background_image_data
     }
 
-    int add_marker_rectangle(int x, int y, int w, int h)
+    void add_overlay(CHAR *filename, int offset_x, int offset_y)
+    {
+        if (g_overlays.n_used == g_overlays.n_allocated) {
+            g_overlays.n_allocated = g_overlays.n_allocated ? 2 * g_overlays.n_allocated : 4;
+            OverlaySpec *new_array = (OverlaySpec*)counted_realloc(g_overlays.array, g_overlays.n_allocated * sizeof(OverlaySpec));
+            if (!new_array)
+                exit_error("out of memory: could not grow overlay array");
+            g_overlays.array = new_array;
+        }
+        assert(g_overlays.n_used < g_overlays.n_allocated);
+        g_overlays.array[g_overlays.n_used].filename = filename;
+        g_overlays.array[g_overlays.n_used].offset_x = offset_x;
+        g_overlays.array[g_overlays.n_used].offset_y = offset_y;
+        g_overlays.n_used++;
+    }
+
+    void init_marker_window_array(MarkerWindowArray *markers, int n_allocated)
+    {
+        markers->n_allocated = max(n_allocated, 1);
+        markers->n_used = 0;
+        markers->array = (MarkerWindow*)counted_malloc(markers->n_allocated * sizeof(MarkerWindow));
+        if (!markers->array)
+            exit_error("out of memory: could not allocate MarkerWindow array");
+    }
+
+    int add_marker_rectangle(MarkerWindowArray *markers, int x, int y, int w, int h)
     {
         if (w <= 0 || h <= 0)
             return -1;
-        if (g_marker_windows.n_used == g_marker_windows.n_allocated) {
-            g_marker_windows.n_allocated *= 2;
-            MarkerWindow *new_array = (MarkerWindow*)realloc(g_marker_windows.array, g_marker_windows.n_allocated * sizeof(MarkerWindow));
+        if (markers->n_used == markers->n_allocated) {
+            markers->n_allocated *= 2;
+            MarkerWindow *new_array = (MarkerWindow*)counted_realloc(markers->array, markers->n_allocated * sizeof(MarkerWindow));
             if (!new_array)
                 exit_error("out of memory: could not grow marker window array");
-            g_marker_windows.array = new_array;
+            markers->array = new_array;
         }
-        assert(g_marker_windows.n_used < g_marker_windows.n_allocated);
-        g_marker_windows.array[g_marker_windows.n_used].x = x;
-        g_marker_windows.array[g_marker_windows.n_used].y = y;
-        g_marker_windows.array[g_marker_windows.n_used].w = w;
-        g_marker_windows.array[g_marker_windows.n_used].h = h;
-        return g_marker_windows.n_used++;
+        assert(markers->n_used < markers->n_allocated);
+        markers->array[markers->n_used].window = NULL;
+        markers->array[markers->n_used].x = x;
+        markers->array[markers->n_used].y = y;
+        markers->array[markers->n_used].w = w;
+        markers->array[markers->n_used].h = h;
+        return markers->n_used++;
     }
         
-    bool transparent(uint8_t *data, int x, int y, int stride)
+    // bit (x % 64) of word (x / 64) in a row is set if pixel x is transparent
+    struct TransparencyMask {
+        int width;
+        int height;
+        int words_per_row;
+        uint64_t *bits;
+    };
+
+    void init_transparency_mask(TransparencyMask *mask, int width, int height)
     {
-        return data[stride * y + 4 * x + 3] < 255;
+        mask->width = width;
+        mask->height = height;
+        mask->words_per_row = (width + 63) / 64;
+        mask->bits = (uint64_t*)counted_calloc(max((size_t)mask->words_per_row * height, (size_t)1), sizeof(uint64_t));
+        if (!mask->bits)
+            exit_error("out of memory: could not allocate transparency mask");
     }
 
-    // XXX @Leak g_marker_windows is never freed currently
-    void load_overlay_image_and_determine_marker_lines()
+    void build_transparency_mask(TransparencyMask *mask, uint8_t *data, int width, int height)
     {
-        char *filename = g_overlay_image_filename;
-        if (!filename)
-            return;
+        init_transparency_mask(mask, width, height);
+        for (int y = 0; y < height; ++y) {
+            uint8_t *pixel = data + (size_t)width * 4 * y;
+            uint64_t *row = mask->bits + (size_t)mask->words_per_row * y;
+            for (int x = 0; x < width; ++x, pixel += 4)
+                row[x / 64] |= (uint64_t)(pixel[3] < 255) << (x % 64);
+        }
+    }
 
-        int image_width;
-        int image_height;
-        int image_n_components;
-        unsigned char *data = stbi_load(filename, &image_width, &image_height, &image_n_components, 0);
-        if (!data)
-            exit_error("could not load image from file '%s'\n", filename);
-        if (image_n_components != 4)
-            exit_error("unexpected number of components in image '%s' (is %d; expected 4)\n", filename, image_n_components);
-
-        int center_x = image_width / 2;
-        int stride = image_width * 4;
-
-        struct RowInfo {
-            int transparent_start;
-            int transparent_end;
-        };
-
-        RowInfo *rows = (RowInfo*)malloc(image_height * sizeof(RowInfo));
-        if (!rows)
-            exit_error("out of memory: could not allocate RowInfo array");
-        for (int y = 0; y < image_height; ++y) {
-            RowInfo *row = rows + y;
-            row->transparent_start = 0;
-            row->transparent_end = 0;
-            bool found_transparent = false;
-            // first look for transparent areas starting from the center and walking left
-            for (int x = center_x; x >= 0; --x) {
-                bool is_transparent = transparent(data, x, y, stride);
-                if (!found_transparent && is_transparent) {
-                    row->transparent_start = x;
-                    row->transparent_end = x + 1;
-                    found_transparent = true;
-                }
-                else if (is_transparent) {
-                    row->transparent_start = x;
-                }
-                else
-                    break;
-            }
-            if (!found_transparent) {
-                // try to find a transparent area to the right of the center
-                for (int x = center_x; x < image_width; ++x) {
-                    bool is_transparent = transparent(data, x, y, stride);
-                    if (is_transparent) {
-                        row->transparent_start = x;
-                        row->transparent_end = x + 1;
-                        found_transparent = true;
-                        break;
-                    }
-                }
+    // check whether any bit in [start; end) is set in the given row of mask words
+    bool any_bit_set(uint64_t *row, int start, int end)
+    {
+        int start_word = start / 64;
+        int last_word = (end - 1) / 64;
+        uint64_t start_mask = ~(uint64_t)0 << (start % 64);
+        uint64_t end_mask = ~(uint64_t)0 >> (63 - (end - 1) % 64);
+        if (start_word == last_word)
+            return (row[start_word] & start_mask & end_mask) != 0;
+        if (row[start_word] & start_mask)
+            return true;
+        for (int i = start_word + 1; i < last_word; ++i)
+            if (row[i])
+                return true;
+        return (row[last_word] & end_mask) != 0;
+    }
+
+    /**
+     * Resample the mask to the given size using a conservative box filter:
+     * a resampled pixel is transparent if any source pixel it covers is.
+     *
+     * Rows are first combined by OR-ing whole mask words (64 pixels at a time,
+     * which the compiler can vectorize), then each resampled pixel checks its
+     * span of the combined row with word masks.
+     */
+    void resample_transparency_mask(TransparencyMask *source, int width, int height, TransparencyMask *result)
+    {
+        init_transparency_mask(result, width, height);
+        uint64_t *combined = (uint64_t*)counted_malloc(max(source->words_per_row, 1) * sizeof(uint64_t));
+        if (!combined)
+            exit_error("out of memory: could not allocate resampling buffer");
+        for (int y = 0; y < height; ++y) {
+            int source_y0 = (int)((int64_t)y * source->height / height);
+            int source_y1 = (int)(((int64_t)(y + 1) * source->height + height - 1) / height);
+            source_y1 = max(source_y1, source_y0 + 1);
+
+            memset(combined, 0, source->words_per_row * sizeof(uint64_t));
+            for (int source_y = source_y0; source_y < source_y1; ++source_y) {
+                uint64_t *source_row = source->bits + (size_t)source->words_per_row * source_y;
+                for (int i = 0; i < source->words_per_row; ++i)
+                    combined[i] |= source_row[i];
             }
-            if (!found_transparent)
-                continue;
-            for (int x = row->transparent_end; x < image_width; ++x) {
-                if (!transparent(data, x, y, stride))
-                    break;
-                row->transparent_end++;
+
+            uint64_t *row = result->bits + (size_t)result->words_per_row * y;
+            for (int x = 0; x < width; ++x) {
+                int source_x0 = (int)((int64_t)x * source->width / width);
+                int source_x1 = (int)(((int64_t)(x + 1) * source->width + width - 1) / width);
+                source_x1 = max(source_x1, source_x0 + 1);
+                if (any_bit_set(combined, source_x0, source_x1))
+                    row[x / 64] |= (uint64_t)1 << (x % 64);
             }
         }
-        stbi_image_free(data);
+        free(combined);
+    }
 
-        g_marker_windows.n_allocated = 1;
-        g_marker_windows.n_used = 0;
-        g_marker_windows.array = (MarkerWindow*)malloc(g_marker_windows.n_allocated * sizeof(MarkerWindow));
-        if (!g_marker_windows.array)
-            exit_error("out of memory: could not allocate MarkerWindow array");
+    void init_span_region(SpanRegion *region, int y0, int height)
+    {
+        region->y0 = y0;
+        region->height = max(height, 0);
+        region->n_spans = 0;
+        region->n_allocated = max(region->height, 1);
+        region->row_starts = (int*)counted_malloc((region->height + 1) * sizeof(int));
+        region->spans = (Span*)counted_malloc(region->n_allocated * sizeof(Span));
+        if (!region->row_starts || !region->spans)
+            exit_error("out of memory: could not allocate span region");
+        region->row_starts[0] = 0;
+    }
 
-        int prev_left_index = -1;
-        int prev_right_index = -1;
-        for (int y = 0; y < image_height; ++y) {
-            RowInfo *row = rows + y;
-            // XXX @Incomplete handle non-overlapping transparent ranges in adjacent rows
-            if (row->transparent_start >= row->transparent_end) {
-                // no transparent pixels in this row
-                // if this is the first fully opaque row after a transparent one, draw a horizontal marker
-                if (y > 0 && rows[y - 1].transparent_start < rows[y - 1].transparent_end)
-                    add_marker_rectangle(rows[y - 1].transparent_start, y, rows[y - 1].transparent_end - rows[y - 1].transparent_start, 1);
-                prev_left_index = -1;
-                prev_right_index = -1;
-                continue;
-            }
-            // we have at least one transparent pixel in this row
-            if (y > 0 && rows[y - 1].transparent_start >= rows[y - 1].transparent_end) {
-                // the row before was fully opaque, so draw a horizontal marker in it
-                add_marker_rectangle(row->transparent_start, y - 1, row->transparent_end - row->transparent_start, 1);
-            }
-            for (int i = 0; i < 2; ++i) {
-                int marker_x;
-                int prev_index;
-                if (i == 0 && row->transparent_start > 0) {
-                    marker_x = row->transparent_start - 1;
-                    prev_index = prev_left_index;
-                }
-                else if (i == 1 && row->transparent_end > row->transparent_start + 1) {
-                    marker_x = row->transparent_end;
-                    prev_index = prev_right_index;
-                }
-                else
-                    continue;
+    void free_span_region(SpanRegion *region)
+    {
+        free(region->row_starts);
+        free(region->spans);
+        memset(region, 0, sizeof(*region));
+    }
 
-                if (prev_index >= 0) {
-                    int old_x = g_marker_windows.array[prev_index].x;
-                    if (marker_x == old_x) {
-                        g_marker_windows.array[prev_index].h++;
-                        continue;
-                    }
-                    int link_x = min(marker_x, old_x);
-                    int link_w = max(marker_x, old_x) - link_x + 1;
-                    bool shrinking = (i == 0 && marker_x > old_x) || (i == 1 && marker_x < old_x);
-                    assert(y > 0);
-                    add_marker_rectangle(link_x, shrinking ? y : (y - 1), link_w, 1);
-                }
-                int index = add_marker_rectangle(marker_x, y, 1, 1);
-                if (i == 0)
-                    prev_left_index = index;
-                else
-                    prev_right_index = index;
-            }
+    /**
+     * Append a span to the row that is currently being built (see end_span_row).
+     * Spans must be added from left to right and must not touch each other.
+     */
+    void add_span(SpanRegion *region, int start, int end)
+    {
+        if (start >= end)
+            return;
+        if (region->n_spans == region->n_allocated) {
+            region->n_allocated *= 2;
+            Span *new_spans = (Span*)counted_realloc(region->spans, region->n_allocated * sizeof(Span));
+            if (!new_spans)
+                exit_error("out of memory: could not grow span region");
+            region->spans = new_spans;
         }
-        free(rows);
+        region->spans[region->n_spans].start = start;
+        region->spans[region->n_spans].end = end;
+        region->n_spans++;
     }
 
-    void create_marker_windows(HINSTANCE hInstance, ATOM window_class)
+    // finish row y0 + i of the region; further spans go to the next row
+    void end_span_row(SpanRegion *region, int i)
     {
-        for (int index = 0; index < g_marker_windows.n_used; ++index)
-        {
-            MarkerWindow *marker = g_marker_windows.array + index;
+        assert(i < region->height);
+        region->row_starts[i + 1] = region->n_spans;
+    }
+
+    /**
+     * \return the number of spans in row y, which start at *spans
+     */
+    int get_span_row(SpanRegion *region, int y, Span **spans)
+    {
+        int i = y - region->y0;
+        if (i < 0 || i >= region->height)
+            return 0;
+        *spans = region->spans + region->row_starts[i];
+        return region->row_starts[i + 1] - region->row_starts[i];
+    }
 
-            HWND window = ::CreateWindowEx(
-                    WS_EX_TOPMOST, // dwExStyle
-                    reinterpret_cast<LPCTSTR>(window_class), // lpClassName
-                    TEXT("Overhead Marker"), // lpWindowName
-                    WS_POPUP | WS_VISIBLE, // dwStyle
-                    marker->x, marker->y, marker->w, marker->h, // X, Y, nWidth, nHeight
-                    g_main_window, // hWndParent
-                    0, // hMenu
-                    hInstance, // hInstance
-                    NULL); // lpParam
-            if (!window)
-                exit_windows_system_error("could not create marker window");
-            marker->window = window;
+    void init_span_region_rect(SpanRegion *region, int x, int y, int w, int h)
+    {
+        init_span_region(region, y, h);
+        for (int i = 0; i < region->height; ++i) {
+            add_span(region, x, x + w);
+            end_span_row(region, i);
         }
     }
-        
-    void create_main_window(HINSTANCE hInstance, ATOM window_class)
+
+    /**
+     * Collect the transparent pixels of the mask. Mask words without a change
+     * of transparency are skipped as a whole.
+     */
+    void build_span_region(SpanRegion *region, TransparencyMask *mask)
     {
-        HWND window = ::CreateWindowEx(
-                WS_EX_TOPMOST /* | WS_EX_LAYERED see :LayeredWindow */, // dwExStyle
-                reinterpret_cast<LPCTSTR>(window_class), // lpClassName
-                TEXT("Overhead Display"), // lpWindowName
-                WS_POPUP | WS_VISIBLE, // dwStyle
-                g_position_x, g_position_y, g_background_image_width, g_background_image_height, // X, Y, nWidth, nHeight
-                0, // hWndParent
-                0, // hMenu
-                hInstance, // hInstance
-                NULL); // lpParam
-        if (!window)
-            exit_windows_system_error("could not create main window");
-        g_main_window = window;
+        init_span_region(region, 0, mask->height);
+        for (int y = 0; y < mask->height; ++y) {
+            uint64_t *row = mask->bits + (size_t)mask->words_per_row * y;
+            int start = -1; // of the span we are in, if any
+            for (int i = 0; i < mask->words_per_row; ++i) {
+                uint64_t word = row[i];
+                if (word == ((start < 0) ? 0 : ~(uint64_t)0))
+                    continue;
+                for (int bit = 0; bit < 64; ++bit) {
+                    bool is_transparent = (word >> bit) & 1;
+                    if (is_transparent && start < 0)
+                        start = 64 * i + bit;
+                    else if (!is_transparent && start >= 0) {
+                        add_span(region, start, 64 * i + bit);
+                        start = -1;
+                    }
+                }
+            }
+            // bits beyond the width are never set, so this only happens if the width is a multiple of 64
+            if (start >= 0)
+                add_span(region, start, mask->width);
+            end_span_row(region, y);
+        }
+    }
 
-        // XXX If only OBS would work with the compositing window manager, we could do so much nice
-        //     stuff with a layered window. :LayeredWindow
-        //     In the future, if we can assume Windows >= 8 and the DWM is running,
-        //     we might actually rather want to use DirectComposition.
-        //     See: http://www.pjblewis.com/site/posts/2016-04-27-p2-efficient-alpha-blended-windows-directcomposition.html
-#if 0
-        if (!::SetLayeredWindowAttributes(
-                    window, // hwnd,
-                    RGB(0, 0, 0), // crKey
-                    128, // bAlpha
-                    LWA_ALPHA /* | LWA_COLORKEY */)) // dwFlags
-            exit_windows_system_error("could not set layered window attributes");
-#endif
+    void translate_span_region(SpanRegion *region, int dx, int dy)
+    {
+        region->y0 += dy;
+        for (int i = 0; i < region->n_spans; ++i) {
+            region->spans[i].start += dx;
+            region->spans[i].end += dx;
+        }
     }
 
-    bool calculate_time_until_expiry(SYSTEMTIME *remaining)
-    {
-        bool still_running = true;
-        SYSTEMTIME current_time;
-        ::GetLocalTime(&current_time);
-        int64_t delta_ms =
-            (((      (int64_t)g_expiry_time.wHour         - (int64_t)current_time.wHour)
-            *   60 + (int64_t)g_expiry_time.wMinute       - (int64_t)current_time.wMinute)
-            *   60 + (int64_t)g_expiry_time.wSecond       - (int64_t)current_time.wSecond)
-            * 1000 + (int64_t)g_expiry_time.wMilliseconds - (int64_t)current_time.wMilliseconds;
-        if (delta_ms < 0) {
-            delta_ms = 0;
-            still_running = false;
-        }
-        memset(remaining, 0, sizeof(*remaining));
-        remaining->wHour   = (WORD)(delta_ms  / (60 * 60 * 1000));
-        delta_ms -= remaining->wHour          * (60 * 60 * 1000);
-        remaining->wMinute = (WORD)(delta_ms  / (     60 * 1000));
-        delta_ms -= remaining->wMinute        * (     60 * 1000);
-        remaining->wSecond = (WORD)(delta_ms  / (          1000));
-        delta_ms -= remaining->wSecond        * (          1000);
-        remaining->wMilliseconds = (WORD)delta_ms;
-        return still_running;
+    enum RegionOp {
+        REGION_UNION,
+        REGION_INTERSECT,
+        REGION_SUBTRACT, // a minus b
+    };
+
+    // x coordinate of boundary i of the spans (even: start of span i / 2, odd: its end)
+    int get_span_boundary(Span *spans, int n_spans, int i)
+    {
+        if (i >= 2 * n_spans)
+            return INT_MAX;
+        return (i & 1) ? spans[i / 2].end : spans[i / 2].start;
     }
 
     /**
-     * \note There are no sane conventions for parsing the command line on Windows.
-     *       We try to do something simple here that allows the user to specify
-     *       paths containing whitespace by using quotes in a way that is also
-     *       understood by DOS commands like 'dir'. For example, the following are
-     *       valid ways to specify the file 'back ground.png' in 'example directory':
-     *
-     *           overhead --background="example directory\back ground.png"
-     *           overhead --background="example directory"\"back ground.png"
-     *           overhead "--background=example directory\back ground.png"
+     * Combine regions a and b into a new region *result.
      *
-     *       and even the very ugly
-     *
-     *           overhead --background="example directory\"foo.png
-     *
-     *       (This last one is the reason why we cannot support backslash-escaped
-     *       quotes within quoted string arguments.)
-     *       Note also that quotes themselves are not allowed within
-     *       Windows filenames.
+     * Each row is processed by walking the span boundaries of both rows in
+     * order, so the time is proportional to the number of spans.
      */
-    char *consume_and_dup_command_line_argument(char **cmdline)
+    void combine_span_regions(SpanRegion *a, SpanRegion *b, RegionOp op, SpanRegion *result)
     {
-        // XXX @Incomplete extend this function for UNICODE
+        int y0 = a->y0;
+        int y1 = a->y0 + a->height;
+        if (op == REGION_UNION) {
+            if (!a->height) {
+                y0 = b->y0;
+                y1 = b->y0 + b->height;
+            }
+            else if (b->height) {
+                y0 = min(y0, b->y0);
+                y1 = max(y1, b->y0 + b->height);
+            }
+        }
+        else if (op == REGION_INTERSECT) {
+            y0 = max(y0, b->y0);
+            y1 = min(y1, b->y0 + b->height);
+        }
+        init_span_region(result, y0, y1 - y0);
+        for (int y = y0; y < y1; ++y) {
+            Span *a_spans = nullptr;
+            Span *b_spans = nullptr;
+            int n_a = get_span_row(a, y, &a_spans);
+            int n_b = get_span_row(b, y, &b_spans);
+            int i_a = 0;
+            int i_b = 0;
+            bool inside = false;
+            int start = 0;
+            while (i_a < 2 * n_a || i_b < 2 * n_b) {
+                int x_a = get_span_boundary(a_spans, n_a, i_a);
+                int x_b = get_span_boundary(b_spans, n_b, i_b);
+                int x = min(x_a, x_b);
+                if (x_a == x)
+                    i_a++;
+                if (x_b == x)
+                    i_b++;
+                // we are inside a span after passing its start (an odd number of boundaries)
+                bool in_a = i_a & 1;
+                bool in_b = i_b & 1;
+                bool in_result;
+                switch (op) {
+                    case REGION_UNION:     in_result = in_a || in_b; break;
+                    case REGION_INTERSECT: in_result = in_a && in_b; break;
+                    default:               in_result = in_a && !in_b; break;
+                }
+                if (in_result && !inside)
+                    start = x;
+                else if (!in_result && inside)
+                    add_span(result, start, x);
+                inside = in_result;
+            }
+            end_span_row(result, y - y0);
+        }
+    }
 
-        // skip leading whitespace
-        while (**cmdline && isspace(**cmdline))
-            (*cmdline)++;
+    // replace *region with the result of combining it with other
+    void combine_span_regions_in_place(SpanRegion *region, SpanRegion *other, RegionOp op)
+    {
+        SpanRegion result;
+        combine_span_regions(region, other, op, &result);
+        free_span_region(region);
+        *region = result;
+    }
 
-        if (!**cmdline)
-            return nullptr;
+    typedef void ParallelJobFn(void *context, int index);
 
-        size_t maxsize = strlen(*cmdline) + 1;
-        char *arg = (char *)malloc(maxsize);
-        if (!arg)
-            exit_error("out of memory: could not allocate space for command line argument\n");
+    struct ParallelJobs {
+        ParallelJobFn *fn;
+        void *context;
+        int n_jobs;
+        volatile LONG n_started;
+    };
 
-        char *arg_ptr = arg;
-        bool in_quotes = false;
-        while (true) {
+    DWORD WINAPI parallel_jobs_thread(LPVOID param)
+    {
+        ParallelJobs *jobs = (ParallelJobs*)param;
+        LONG index;
+        while ((index = ::InterlockedIncrement(&jobs->n_started) - 1) < jobs->n_jobs)
+            jobs->fn(jobs->context, (int)index);
+        return 0;
+    }
+
+    int get_number_of_processors()
+    {
+        SYSTEM_INFO info;
+        ::GetSystemInfo(&info);
+        return max((int)info.dwNumberOfProcessors, 1);
+    }
+
+    /**
+     * Call fn(context, index) for every index in [0; n_jobs) using as many
+     * threads as there are processors (including the calling thread) and
+     * return when all calls are done.
+     */
+    void run_parallel_jobs(int n_jobs, ParallelJobFn *fn, void *context)
+    {
+        ParallelJobs jobs = { fn, context, n_jobs, 0 };
+        HANDLE threads[MAXIMUM_WAIT_OBJECTS];
+        int n_threads = min(min(get_number_of_processors(), n_jobs) - 1, MAXIMUM_WAIT_OBJECTS);
+        for (int i = 0; i < n_threads; ++i) {
+            threads[i] = ::CreateThread(
+                    NULL, // lpThreadAttributes
+                    0, // dwStackSize
+                    parallel_jobs_thread, // lpStartAddress
+                    &jobs, // lpParameter
+                    0, // dwCreationFlags
+                    NULL); // lpThreadId
+            if (!threads[i])
+                exit_windows_system_error("could not create worker thread");
+        }
+        (void)parallel_jobs_thread(&jobs);
+        if (n_threads > 0) {
+            if (::WaitForMultipleObjects(n_threads, threads, TRUE, INFINITE) == WAIT_FAILED)
+                exit_windows_system_error("could not wait for worker threads");
+            for (int i = 0; i < n_threads; ++i)
+                (void)::CloseHandle(threads[i]);
+        }
+    }
+
+    /**
+     * \return the contents of the file or nullptr if it could not be read
+     */
+    uint8_t *read_entire_file(char *filename, int *size)
+    {
+        #pragma warning (suppress : 4996) // no need for fopen_s
+        FILE *file = fopen(filename, "rb");
+        if (!file)
+            return nullptr;
+        long file_size = -1;
+        if (fseek(file, 0, SEEK_END) == 0)
+            file_size = ftell(file);
+        if (file_size < 0 || file_size > INT_MAX) {
+            fclose(file);
+            return nullptr;
+        }
+        rewind(file);
+        uint8_t *data = (uint8_t*)counted_malloc(max(file_size, 1L));
+        if (!data)
+            exit_error("out of memory: could not allocate memory for file '%s'\n", filename);
+        if (fread(data, 1, file_size, file) != (size_t)file_size) {
+            free(data);
+            data = nullptr;
+        }
+        fclose(file);
+        *size = (int)file_size;
+        return data;
+    }
+
+    /**
+     * How a span of a SpanRegion connects to the spans of the adjacent rows
+     * and which marker rectangles follow its edges. Spans of adjacent rows
+     * are connected if they overlap or touch diagonally.
+     */
+    struct SpanOutline {
+        int n_above; // number of connected spans in the row above
+        int n_below;
+        int above; // index of the last connected span in the row above, if any
+        int below;
+        int parent; // to find the transparent regions (union-find)
+        int edge_x[2]; // x coordinates of the left and right marker lines
+        int edge_markers[2]; // indices of their current marker rectangles (-1 if outside the image)
+    };
+
+    int find_transparent_region(SpanOutline *outlines, int index)
+    {
+        while (outlines[index].parent != index) {
+            outlines[index].parent = outlines[outlines[index].parent].parent;
+            index = outlines[index].parent;
+        }
+        return index;
+    }
+
+    /**
+     * Connect every span of the region to the spans of the row above.
+     *
+     * \return an array of region->n_spans outlines, to be freed by the caller
+     */
+    SpanOutline *link_span_rows(SpanRegion *region)
+    {
+        SpanOutline *outlines = (SpanOutline*)counted_malloc(max(region->n_spans, 1) * sizeof(SpanOutline));
+        if (!outlines)
+            exit_error("out of memory: could not allocate SpanOutline array");
+        for (int i = 0; i < region->n_spans; ++i)
+            outlines[i] = { 0, 0, -1, -1, i, { 0, 0 }, { -1, -1 } };
+        for (int y = region->y0 + 1; y < region->y0 + region->height; ++y) {
+            Span *above = nullptr;
+            Span *below = nullptr;
+            int n_above = get_span_row(region, y - 1, &above);
+            int n_below = get_span_row(region, y, &below);
+            int i = 0;
+            int j = 0;
+            while (i < n_above && j < n_below) {
+                if (above[i].start <= below[j].end && below[j].start <= above[i].end) {
+                    int a = (int)(above + i - region->spans);
+                    int b = (int)(below + j - region->spans);
+                    outlines[a].n_below++;
+                    outlines[a].below = b;
+                    outlines[b].n_above++;
+                    outlines[b].above = a;
+                    outlines[find_transparent_region(outlines, a)].parent = find_transparent_region(outlines, b);
+                }
+                // the span that ends first cannot be connected to any further span of the other row
+                if (above[i].end < below[j].end)
+                    i++;
+                else
+                    j++;
+            }
+        }
+        return outlines;
+    }
+
+    /**
+     * \return true if the span continues the outline of the span above it,
+     *         which is the case if the two are only connected to each other
+     */
+    bool continues_span_above(SpanOutline *outlines, int index)
+    {
+        return outlines[index].n_above == 1 && outlines[outlines[index].above].n_below == 1;
+    }
+
+    // \return the index of the span continuing the outline of the given one or -1
+    int get_next_outlined_span(SpanOutline *outlines, int index)
+    {
+        int below = outlines[index].below;
+        return (outlines[index].n_below == 1 && continues_span_above(outlines, below)) ? below : -1;
+    }
+
+    // add horizontal markers in row y for the pixels in [start; end) that are not covered by the given spans
+    void add_markers_between_spans(MarkerWindowArray *markers, int y, int start, int end, Span *spans, int n_spans)
+    {
+        int x = start;
+        for (int i = 0; i < n_spans && spans[i].start < end; ++i) {
+            if (spans[i].end <= x)
+                continue;
+            if (spans[i].start > x)
+                add_marker_rectangle(markers, x, y, spans[i].start - x, 1);
+            x = spans[i].end;
+        }
+        if (x < end)
+            add_marker_rectangle(markers, x, y, end - x, 1);
+    }
+
+    /**
+     * Append the marker rectangles outlining every span of the region.
+     * Spans that are only connected to each other form a chain whose left and
+     * right edges are followed by vertical markers. Where a chain begins or
+     * ends (also where transparent areas split or merge), horizontal markers
+     * close the outline above or below it.
+     *
+     * \return the number of transparent regions
+     */
+    int add_markers_for_rows(SpanRegion *region, int image_height, MarkerWindowArray *markers)
+    {
+        SpanOutline *outlines = link_span_rows(region);
+        for (int y = region->y0; y < region->y0 + region->height; ++y) {
+            Span *spans = nullptr;
+            Span *spans_above = nullptr;
+            Span *spans_below = nullptr;
+            int n_spans = get_span_row(region, y, &spans);
+            int n_above = get_span_row(region, y - 1, &spans_above);
+            int n_below = get_span_row(region, y + 1, &spans_below);
+            for (int j = 0; j < n_spans; ++j) {
+                Span *span = spans + j;
+                int span_index = (int)(span - region->spans);
+                SpanOutline *outline = outlines + span_index;
+                SpanOutline *above = nullptr;
+                if (continues_span_above(outlines, span_index))
+                    above = outlines + outline->above;
+                else if (y > 0) {
+                    // draw a horizontal marker where the row above is opaque
+                    add_markers_between_spans(markers, y - 1, span->start, span->end, spans_above, n_above);
+                }
+                for (int i = 0; i < 2; ++i) {
+                    int marker_x = (i == 0) ? (span->start - 1) : span->end;
+                    if (above) {
+                        int old_x = above->edge_x[i];
+                        if (marker_x == old_x) {
+                            outline->edge_x[i] = marker_x;
+                            outline->edge_markers[i] = above->edge_markers[i];
+                            if (above->edge_markers[i] >= 0)
+                                markers->array[above->edge_markers[i]].h++;
+                            continue;
+                        }
+                        int link_x = min(marker_x, old_x);
+                        int link_w = max(marker_x, old_x) - link_x + 1;
+                        if (link_x < 0) {
+                            // the left marker line was or is outside the image
+                            link_w += link_x;
+                            link_x = 0;
+                        }
+                        bool shrinking = (i == 0 && marker_x > old_x) || (i == 1 && marker_x < old_x);
+                        assert(y > 0);
+                        add_marker_rectangle(markers, link_x, shrinking ? y : (y - 1), link_w, 1);
+                    }
+                    outline->edge_x[i] = marker_x;
+                    outline->edge_markers[i] = (marker_x >= 0) ? add_marker_rectangle(markers, marker_x, y, 1, 1) : -1;
+                }
+                if (get_next_outlined_span(outlines, span_index) < 0 && y + 1 < image_height) {
+                    // draw a horizontal marker where the row below is opaque
+                    add_markers_between_spans(markers, y + 1, span->start, span->end, spans_below, n_below);
+                }
+            }
+        }
+        int n_regions = 0;
+        for (int i = 0; i < region->n_spans; ++i)
+            if (outlines[i].parent == i)
+                n_regions++;
+        free(outlines);
+        return n_regions;
+    }
+
+    /**
+     * Build a copy of the region in which the left and right edges of every
+     * chain of spans (see add_markers_for_rows) each change only between runs
+     * of rows in which the original edge varies by at most tolerance pixels.
+     * Within a run, the edge is moved to the outermost original position, so
+     * the marker lines stay outside the transparent area and at most tolerance
+     * pixels away from it, but rounded corners and anti-aliased edges no
+     * longer turn into staircases of tiny markers.
+     */
+    void simplify_span_edges(SpanRegion *region, int tolerance, SpanRegion *result)
+    {
+        SpanOutline *outlines = link_span_rows(region);
+        Span *widened = (Span*)counted_malloc(max(region->n_spans, 1) * sizeof(Span));
+        if (!widened)
+            exit_error("out of memory: could not allocate Span array");
+        memcpy(widened, region->spans, region->n_spans * sizeof(Span));
+        for (int chain = 0; chain < region->n_spans; ++chain) {
+            if (continues_span_above(outlines, chain))
+                continue;
+            for (int edge = 0; edge < 2; ++edge) {
+                int index = chain;
+                while (index >= 0) {
+                    int run_start = index;
+                    int lowest = (edge == 0) ? region->spans[index].start : region->spans[index].end;
+                    int highest = lowest;
+                    for (index = get_next_outlined_span(outlines, index); index >= 0; index = get_next_outlined_span(outlines, index)) {
+                        int x = (edge == 0) ? region->spans[index].start : region->spans[index].end;
+                        if (max(highest, x) - min(lowest, x) > tolerance)
+                            break;
+                        lowest = min(lowest, x);
+                        highest = max(highest, x);
+                    }
+                    for (int run_index = run_start; run_index != index; run_index = get_next_outlined_span(outlines, run_index)) {
+                        if (edge == 0)
+                            widened[run_index].start = lowest;
+                        else
+                            widened[run_index].end = highest;
+                    }
+                }
+            }
+        }
+        free(outlines);
+
+        // widened spans of a row may now overlap, so sort and merge them
+        init_span_region(result, region->y0, region->height);
+        for (int i = 0; i < region->height; ++i) {
+            Span *spans = widened + region->row_starts[i];
+            int n_spans = region->row_starts[i + 1] - region->row_starts[i];
+            for (int j = 1; j < n_spans; ++j)
+                for (int k = j; k > 0 && spans[k - 1].start > spans[k].start; --k) {
+                    Span swapped = spans[k];
+                    spans[k] = spans[k - 1];
+                    spans[k - 1] = swapped;
+                }
+            int j = 0;
+            while (j < n_spans) {
+                int start = spans[j].start;
+                int end = spans[j].end;
+                for (j++; j < n_spans && spans[j].start <= end; ++j)
+                    end = max(end, spans[j].end);
+                add_span(result, start, end);
+            }
+            end_span_row(result, i);
+        }
+        free(widened);
+    }
+
+    /**
+     * Append the marker rectangles (in image coordinates) outlining the
+     * transparent region of one overlay image to *markers.
+     *
+     * If tolerance > 0, the outline is simplified (see simplify_span_edges) and
+     * the number of marker rectangles saved by that is stored in *n_eliminated.
+     * If simplification does not save any, the original outline is kept.
+     *
+     * \return the number of transparent regions found
+     *
+     * \note This function is called concurrently from several threads,
+     *       so it must not touch any global state.
+     */
+    int determine_marker_lines(SpanRegion *region, int image_height, int tolerance, MarkerWindowArray *markers, int *n_eliminated)
+    {
+        *n_eliminated = 0;
+        int n_before = markers->n_used;
+        int n_regions = add_markers_for_rows(region, image_height, markers);
+        if (tolerance > 0) {
+            // widening the spans can also add link markers where adjacent rows
+            // do not overlap, so only use the simplified outline if it is smaller
+            SpanRegion simplified_region;
+            simplify_span_edges(region, tolerance, &simplified_region);
+            MarkerWindowArray simplified;
+            init_marker_window_array(&simplified, 1);
+            (void)add_markers_for_rows(&simplified_region, image_height, &simplified);
+            free_span_region(&simplified_region);
+            int n_unsimplified = markers->n_used - n_before;
+            if (simplified.n_used < n_unsimplified) {
+                markers->n_used = n_before;
+                for (int i = 0; i < simplified.n_used; ++i) {
+                    MarkerWindow *marker = simplified.array + i;
+                    add_marker_rectangle(markers, marker->x, marker->y, marker->w, marker->h);
+                }
+                *n_eliminated = n_unsimplified - simplified.n_used;
+            }
+            free(simplified.array);
+        }
+        return n_regions;
+    }
+
+    struct OverlayAnalysis {
+        OverlaySpec *overlay;
+        int width;
+        int height;
+        int n_frames;
+        uint8_t *pixels; // n_frames RGBA images
+        int *delays_ms; // only set for animations
+        AnimationFrame *frames;
+        bool clip_to_monitor;
+        RECT monitor; // screen rectangle of the monitor showing the overlay
+    };
+
+    struct FrameJob {
+        OverlayAnalysis *analysis;
+        int frame;
+    };
+
+    /**
+     * Load the image file of the overlay and prepare the analysis of its frames.
+     *
+     * \return nullptr on success or a description of the problem
+     */
+    const char *decode_overlay_image(OverlayAnalysis *analysis)
+    {
+        char *filename = analysis->overlay->filename;
+
+        int file_size;
+        uint8_t *file_data = read_entire_file(filename, &file_size);
+        if (!file_data)
+            return "could not read file";
+        int image_n_components;
+        if (file_size >= 4 && memcmp(file_data, "GIF8", 4) == 0) {
+            // GIF frames are always returned as RGBA, composited onto the full canvas
+            analysis->pixels = stbi_load_gif_from_memory(file_data, file_size, &analysis->delays_ms,
+                    &analysis->width, &analysis->height, &analysis->n_frames, &image_n_components, 4);
+            image_n_components = 4;
+        }
+        else {
+            analysis->pixels = stbi_load_from_memory(file_data, file_size,
+                    &analysis->width, &analysis->height, &image_n_components, 0);
+            analysis->n_frames = 1;
+        }
+        free(file_data);
+        if (!analysis->pixels)
+            return "could not decode image";
+        if (image_n_components != 4) {
+            stbi_image_free(analysis->pixels);
+            analysis->pixels = nullptr;
+            return "unexpected number of components in image (expected 4)";
+        }
+
+        analysis->frames = (AnimationFrame*)counted_malloc(analysis->n_frames * sizeof(AnimationFrame));
+        if (!analysis->frames)
+            exit_error("out of memory: could not allocate AnimationFrame array");
+        for (int frame = 0; frame < analysis->n_frames; ++frame) {
+            AnimationFrame *anim_frame = analysis->frames + frame;
+            init_marker_window_array(&anim_frame->markers, 1);
+            // like most browsers, treat very short GIF frame delays as 100 ms
+            int delay_ms = analysis->delays_ms ? analysis->delays_ms[frame] : 0;
+            anim_frame->delay_ms = (delay_ms <= 10) ? 100 : delay_ms;
+            anim_frame->n_regions = 0;
+            anim_frame->n_eliminated = 0;
+            anim_frame->deltas = nullptr;
+            anim_frame->n_deltas = 0;
+            anim_frame->matches = nullptr;
+        }
+        return nullptr;
+    }
+
+    void load_overlay_job(void *context, int index)
+    {
+        OverlayAnalysis *analysis = (OverlayAnalysis*)context + index;
+        const char *error = decode_overlay_image(analysis);
+        if (error)
+            exit_error("could not load overlay image '%s': %s\n", analysis->overlay->filename, error);
+    }
+
+    // size of the overlay after resampling (see --scale and --target-size)
+    void get_overlay_target_size(OverlayAnalysis *analysis, int *target_width, int *target_height)
+    {
+        *target_width = analysis->width;
+        *target_height = analysis->height;
+        if (g_overlay_target_width) {
+            *target_width = g_overlay_target_width;
+            *target_height = g_overlay_target_height;
+        }
+        else if (g_overlay_scale) {
+            *target_width = max((int)(analysis->width * g_overlay_scale + 0.5), 1);
+            *target_height = max((int)(analysis->height * g_overlay_scale + 0.5), 1);
+        }
+    }
+
+    /**
+     * Clip the marker lines of the overlay to the monitor that shows most of
+     * it, so that no windows are created for parts that are off the screen.
+     */
+    void find_overlay_monitor(OverlayAnalysis *analysis)
+    {
+        int target_width;
+        int target_height;
+        get_overlay_target_size(analysis, &target_width, &target_height);
+        RECT bounds;
+        (void)::SetRect(&bounds, analysis->overlay->offset_x, analysis->overlay->offset_y,
+                analysis->overlay->offset_x + target_width, analysis->overlay->offset_y + target_height);
+        HMONITOR monitor = ::MonitorFromRect(&bounds, MONITOR_DEFAULTTONEAREST);
+        MONITORINFO info;
+        info.cbSize = sizeof(info);
+        if (!::GetMonitorInfo(monitor, &info))
+            exit_windows_system_error("could not determine the monitor of overlay '%s'", analysis->overlay->filename);
+        analysis->clip_to_monitor = true;
+        analysis->monitor = info.rcMonitor;
+    }
+
+    void analyze_frame(OverlayAnalysis *analysis, int frame)
+    {
+        MarkerWindowArray *markers = &analysis->frames[frame].markers;
+        uint8_t *data = analysis->pixels + (size_t)frame * analysis->width * analysis->height * 4;
+        TransparencyMask mask;
+        build_transparency_mask(&mask, data, analysis->width, analysis->height);
+        int target_width;
+        int target_height;
+        get_overlay_target_size(analysis, &target_width, &target_height);
+        if (target_width != mask.width || target_height != mask.height) {
+            TransparencyMask resampled;
+            resample_transparency_mask(&mask, target_width, target_height, &resampled);
+            free(mask.bits);
+            mask = resampled;
+        }
+        SpanRegion region;
+        build_span_region(&region, &mask);
+        free(mask.bits);
+        if (g_exclusion.n_spans) {
+            // the exclusion is given in screen coordinates
+            translate_span_region(&region, analysis->overlay->offset_x, analysis->overlay->offset_y);
+            combine_span_regions_in_place(&region, &g_exclusion, REGION_SUBTRACT);
+            translate_span_region(&region, -analysis->overlay->offset_x, -analysis->overlay->offset_y);
+        }
+        if (analysis->clip_to_monitor) {
+            // like the exclusion, the monitor is given in screen coordinates
+            RECT *monitor = &analysis->monitor;
+            SpanRegion visible;
+            init_span_region_rect(&visible, monitor->left - analysis->overlay->offset_x, monitor->top - analysis->overlay->offset_y,
+                    monitor->right - monitor->left, monitor->bottom - monitor->top);
+            combine_span_regions_in_place(&region, &visible, REGION_INTERSECT);
+            free_span_region(&visible);
+        }
+        analysis->frames[frame].n_regions = determine_marker_lines(&region, target_height,
+                g_outline_tolerance, markers, &analysis->frames[frame].n_eliminated);
+        free_span_region(&region);
+        for (int i = 0; i < markers->n_used; ++i) {
+            markers->array[i].x += analysis->overlay->offset_x;
+            markers->array[i].y += analysis->overlay->offset_y;
+        }
+    }
+
+    void analyze_frame_job(void *context, int index)
+    {
+        FrameJob *job = (FrameJob*)context + index;
+        analyze_frame(job->analysis, job->frame);
+    }
+
+    void add_marker_delta(AnimationFrame *frame, int index, int x, int y, int w, int h)
+    {
+        MarkerDelta *delta = frame->deltas + frame->n_deltas++;
+        delta->index = index;
+        delta->x = x;
+        delta->y = y;
+        delta->w = w;
+        delta->h = h;
+    }
+
+    bool same_marker_rectangle(MarkerWindow *a, MarkerWindow *b)
+    {
+        return a->x == b->x && a->y == b->y && a->w == b->w && a->h == b->h;
+    }
+
+    // qsort/bsearch order of pointers to marker rectangles
+    int compare_marker_rectangles(const void *a, const void *b)
+    {
+        MarkerWindow *ma = *(MarkerWindow**)a;
+        MarkerWindow *mb = *(MarkerWindow**)b;
+        int keys_a[4] = { ma->y, ma->x, ma->h, ma->w };
+        int keys_b[4] = { mb->y, mb->x, mb->h, mb->w };
+        for (int i = 0; i < 4; ++i)
+            if (keys_a[i] != keys_b[i])
+                return (keys_a[i] < keys_b[i]) ? -1 : 1;
+        return 0;
+    }
+
+    /**
+     * Find the markers of the next frame that are identical to a marker of
+     * this frame (see AnimationFrame::matches), independently of their
+     * position in the marker arrays.
+     */
+    void determine_frame_matches_job(void *context, int index)
+    {
+        FrameJob *job = (FrameJob*)context + index;
+        OverlayAnalysis *analysis = job->analysis;
+        // the last frame is followed by the first, whose window layout is fixed
+        if (analysis->n_frames < 2 || job->frame == analysis->n_frames - 1)
+            return;
+        AnimationFrame *frame = analysis->frames + job->frame;
+        MarkerWindowArray *current = &frame->markers;
+        MarkerWindowArray *next = &analysis->frames[job->frame + 1].markers;
+        frame->matches = (int*)counted_malloc(max(next->n_used, 1) * sizeof(int));
+        MarkerWindow **sorted = (MarkerWindow**)counted_malloc(max(current->n_used, 1) * sizeof(MarkerWindow*));
+        bool *used = (bool*)counted_calloc(max(current->n_used, 1), sizeof(bool));
+        if (!frame->matches || !sorted || !used)
+            exit_error("out of memory: could not allocate marker matching arrays");
+        for (int i = 0; i < current->n_used; ++i)
+            sorted[i] = current->array + i;
+        qsort(sorted, current->n_used, sizeof(MarkerWindow*), compare_marker_rectangles);
+        for (int j = 0; j < next->n_used; ++j) {
+            frame->matches[j] = -1;
+            MarkerWindow *key = next->array + j;
+            MarkerWindow **found = (MarkerWindow**)bsearch(&key, sorted, current->n_used, sizeof(MarkerWindow*), compare_marker_rectangles);
+            if (!found)
+                continue;
+            // identical rectangles are rare but possible, so use each one only once
+            while (found > sorted && same_marker_rectangle(found[-1], key))
+                found--;
+            for (; found < sorted + current->n_used && same_marker_rectangle(*found, key); ++found) {
+                int i = (int)(*found - current->array);
+                if (!used[i]) {
+                    used[i] = true;
+                    frame->matches[j] = i;
+                    break;
+                }
+            }
+        }
+        free(used);
+        free(sorted);
+    }
+
+    /**
+     * Assign the markers of all frames to the windows of the animation and
+     * determine the window changes between consecutive frames. Windows keep
+     * showing markers that are identical in the next frame, so only the
+     * markers that really changed cause deltas. The first frame shows marker
+     * i in window i (see create_marker_windows).
+     */
+    void determine_animation_deltas(AnimatedOverlay *animation)
+    {
+        int n_windows = animation->n_windows;
+        size_t size = max(n_windows, 1) * sizeof(int);
+        int *marker_windows = (int*)counted_malloc(size); // window of each marker of the current frame
+        int *window_markers = (int*)counted_malloc(size); // marker of the current frame in each window or -1
+        int *next_marker_windows = (int*)counted_malloc(size);
+        int *next_window_markers = (int*)counted_malloc(size);
+        int *free_windows = (int*)counted_malloc(size);
+        if (!marker_windows || !window_markers || !next_marker_windows || !next_window_markers || !free_windows)
+            exit_error("out of memory: could not allocate window assignment arrays");
+
+        MarkerWindowArray *first = &animation->frames[0].markers;
+        for (int w = 0; w < n_windows; ++w) {
+            marker_windows[w] = w;
+            window_markers[w] = (w < first->n_used) ? w : -1;
+        }
+        for (int k = 0; k < animation->n_frames; ++k) {
+            AnimationFrame *frame = animation->frames + k;
+            MarkerWindowArray *current = &frame->markers;
+            frame->deltas = (MarkerDelta*)counted_malloc(max(n_windows, 1) * sizeof(MarkerDelta));
+            if (!frame->deltas)
+                exit_error("out of memory: could not allocate MarkerDelta array");
+
+            if (k == animation->n_frames - 1) {
+                // back to the layout of the first frame
+                for (int w = 0; w < n_windows; ++w) {
+                    MarkerWindow *from = (window_markers[w] >= 0) ? current->array + window_markers[w] : nullptr;
+                    MarkerWindow *to = (w < first->n_used) ? first->array + w : nullptr;
+                    if (!to) {
+                        if (from)
+                            add_marker_delta(frame, w, 0, 0, 0, 0);
+                    }
+                    else if (!from || !same_marker_rectangle(from, to))
+                        add_marker_delta(frame, w, to->x, to->y, to->w, to->h);
+                }
+                break;
+            }
+
+            MarkerWindowArray *next = &animation->frames[k + 1].markers;
+            for (int w = 0; w < n_windows; ++w)
+                next_window_markers[w] = -1;
+            for (int j = 0; j < next->n_used; ++j) {
+                int i = frame->matches[j];
+                next_marker_windows[j] = (i >= 0) ? marker_windows[i] : -1;
+                if (i >= 0)
+                    next_window_markers[marker_windows[i]] = j;
+            }
+            // reuse the windows of vanished markers before showing hidden ones
+            int n_free = 0;
+            for (int w = 0; w < n_windows; ++w)
+                if (next_window_markers[w] < 0 && window_markers[w] >= 0)
+                    free_windows[n_free++] = w;
+            for (int w = 0; w < n_windows; ++w)
+                if (next_window_markers[w] < 0 && window_markers[w] < 0)
+                    free_windows[n_free++] = w;
+            int i_free = 0;
+            for (int j = 0; j < next->n_used; ++j) {
+                if (next_marker_windows[j] >= 0)
+                    continue;
+                assert(i_free < n_free);
+                int w = free_windows[i_free++];
+                next_marker_windows[j] = w;
+                next_window_markers[w] = j;
+                MarkerWindow *to = next->array + j;
+                add_marker_delta(frame, w, to->x, to->y, to->w, to->h);
+            }
+            for (; i_free < n_free; ++i_free) {
+                int w = free_windows[i_free];
+                if (window_markers[w] >= 0)
+                    add_marker_delta(frame, w, 0, 0, 0, 0);
+            }
+            free(frame->matches);
+            frame->matches = nullptr;
+
+            int *swap = marker_windows;
+            marker_windows = next_marker_windows;
+            next_marker_windows = swap;
+            swap = window_markers;
+            window_markers = next_window_markers;
+            next_window_markers = swap;
+        }
+        free(marker_windows);
+        free(window_markers);
+        free(next_marker_windows);
+        free(next_window_markers);
+        free(free_windows);
+    }
+
+    // XXX @Leak g_marker_windows and g_animations are never freed currently
+    void load_overlay_images_and_determine_marker_lines()
+    {
+        int n_overlays = g_overlays.n_used;
+        if (!n_overlays)
+            return;
+
+        OverlayAnalysis *analyses = (OverlayAnalysis*)counted_calloc(n_overlays, sizeof(OverlayAnalysis));
+        if (!analyses)
+            exit_error("out of memory: could not allocate OverlayAnalysis array");
+        for (int i = 0; i < n_overlays; ++i)
+            analyses[i].overlay = g_overlays.array + i;
+
+        // decode all overlays in parallel
+        run_parallel_jobs(n_overlays, load_overlay_job, analyses);
+        if (!g_emit_assets_filename) {
+            // embedded assets must not depend on the monitors of this machine
+            for (int i = 0; i < n_overlays; ++i)
+                find_overlay_monitor(analyses + i);
+        }
+
+        // analyze all frames of all overlays in parallel, then match the
+        // markers of consecutive frames of animations
+        int n_frame_jobs = 0;
+        int n_animations = 0;
+        for (int i = 0; i < n_overlays; ++i) {
+            n_frame_jobs += analyses[i].n_frames;
+            if (analyses[i].n_frames > 1)
+                n_animations++;
+        }
+        FrameJob *frame_jobs = (FrameJob*)counted_malloc(n_frame_jobs * sizeof(FrameJob));
+        if (!frame_jobs)
+            exit_error("out of memory: could not allocate FrameJob array");
+        FrameJob *job = frame_jobs;
+        for (int i = 0; i < n_overlays; ++i)
+            for (int frame = 0; frame < analyses[i].n_frames; ++frame, ++job) {
+                job->analysis = analyses + i;
+                job->frame = frame;
+            }
+        run_parallel_jobs(n_frame_jobs, analyze_frame_job, frame_jobs);
+        run_parallel_jobs(n_frame_jobs, determine_frame_matches_job, frame_jobs);
+        free(frame_jobs);
+
+        // merge the marker rectangles of all static overlays
+        int n_markers = 0;
+        for (int i = 0; i < n_overlays; ++i) {
+            stbi_image_free(analyses[i].pixels);
+            stbi_image_free(analyses[i].delays_ms);
+            for (int frame = 0; frame < analyses[i].n_frames; ++frame)
+                g_n_eliminated_markers += analyses[i].frames[frame].n_eliminated;
+            if (analyses[i].n_frames == 1)
+                n_markers += analyses[i].frames[0].markers.n_used;
+        }
+        init_marker_window_array(&g_marker_windows, n_markers);
+        if (n_animations) {
+            g_animations = (AnimatedOverlay*)counted_calloc(n_animations, sizeof(AnimatedOverlay));
+            if (!g_animations)
+                exit_error("out of memory: could not allocate AnimatedOverlay array");
+        }
+        for (int i = 0; i < n_overlays; ++i) {
+            OverlayAnalysis *analysis = analyses + i;
+            if (analysis->n_frames > 1) {
+                AnimatedOverlay *animation = g_animations + g_n_animations++;
+                animation->frames = analysis->frames;
+                animation->n_frames = analysis->n_frames;
+                for (int frame = 0; frame < analysis->n_frames; ++frame)
+                    animation->n_windows = max(animation->n_windows, analysis->frames[frame].markers.n_used);
+                determine_animation_deltas(animation);
+                continue;
+            }
+            MarkerWindowArray *markers = &analysis->frames[0].markers;
+            for (int index = 0; index < markers->n_used; ++index) {
+                MarkerWindow *marker = markers->array + index;
+                add_marker_rectangle(&g_marker_windows, marker->x, marker->y, marker->w, marker->h);
+            }
+            free(markers->array);
+            free(analysis->frames);
+        }
+        free(analyses);
+    }
+
+    /**
+     * Tell the user how much --tolerance helped if we were started from a
+     * command prompt. We don't open a console window just for this.
+     */
+    void report_outline_simplification()
+    {
+        if (g_outline_tolerance <= 0 || !g_overlays.n_used)
+            return;
+        if (!::AttachConsole(ATTACH_PARENT_PROCESS))
+            return;
+        freopen_s((FILE**)stdout, "CONOUT$", "w", stdout);
+        printf("overhead: --tolerance=%d eliminated %d marker rectangles\n",
+                g_outline_tolerance, g_n_eliminated_markers);
+        fflush(stdout);
+        // the command prompt has already returned, so later errors must not end up there
+        (void)::FreeConsole();
+    }
+
+    /**
+     * Write the background image and the marker rectangles of the static overlays
+     * as C++ tables for compiling them into the program (see --emit-assets).
+     */
+    void emit_embedded_assets()
+    {
+        char *filename = g_emit_assets_filename;
+        if (g_n_animations)
+            exit_error("animated overlays cannot be embedded\n");
+        #pragma warning (suppress : 4996) // no need for fopen_s
+        FILE *file = fopen(filename, "w");
+        if (!file)
+            exit_clib_error("could not open '%s' for writing", filename);
+
+        fprintf(file, "// generated by 'overhead --emit-assets', do not edit\n\n");
+        int width = g_background_image_data ? g_background_image_width : 0;
+        int height = g_background_image_data ? g_background_image_height : 0;
+        fprintf(file, "constexpr int g_embedded_background_width = %d;\n", width);
+        fprintf(file, "constexpr int g_embedded_background_height = %d;\n", height);
+        fprintf(file, "\n// 24-bit BGR, top-down, scanlines padded to multiples of 4 bytes\n");
+        fprintf(file, "constexpr uint8_t g_embedded_background_data[] = {");
+        size_t size = (size_t)get_background_image_scanline_size(width) * height;
+        for (size_t i = 0; i < size; ++i)
+            fprintf(file, "%s%u,", (i % 16) ? " " : "\n    ", g_background_image_data[i]);
+        if (!size)
+            fprintf(file, "\n    0, // unused");
+        fprintf(file, "\n};\n");
+
+        fprintf(file, "\nconstexpr int g_embedded_n_markers = %d;\n", g_marker_windows.n_used);
+        fprintf(file, "\n// x, y, w, h in screen coordinates\n");
+        fprintf(file, "constexpr int32_t g_embedded_markers[][4] = {\n");
+        for (int index = 0; index < g_marker_windows.n_used; ++index) {
+            MarkerWindow *marker = g_marker_windows.array + index;
+            fprintf(file, "    { %d, %d, %d, %d },\n", marker->x, marker->y, marker->w, marker->h);
+        }
+        if (!g_marker_windows.n_used)
+            fprintf(file, "    { 0, 0, 0, 0 }, // unused\n");
+        fprintf(file, "};\n");
+        if (fclose(file) != 0)
+            exit_clib_error("could not write '%s'", filename);
+    }
+
+#ifdef OVERHEAD_EMBEDDED_ASSETS
+    /**
+     * Use the background image and marker rectangles compiled into the program
+     * instead of loading and analyzing image files.
+     */
+    void use_embedded_assets()
+    {
+        static MarkerWindow marker_windows[g_embedded_n_markers ? g_embedded_n_markers : 1];
+
+        if (g_background_image_filename || g_overlays.n_used)
+            exit_usage("this build of overhead has its background and overlays compiled in\n");
+        // these options only affect loading images, which this build does not do
+        if (g_overlay_scale || g_overlay_target_width || g_outline_tolerance || g_exclusion.n_spans || g_watch_background)
+            exit_usage("--scale, --target-size, --tolerance, --exclude and --watch must be given when "
+                    "embedding the assets (see build.bat), not to this build of overhead\n");
+        if (g_embedded_background_width) {
+            set_background_image_size(g_embedded_background_width, g_embedded_background_height);
+            g_background_image_data = (uint8_t*)g_embedded_background_data; // only ever read
+        }
+        g_marker_windows.array = marker_windows;
+        g_marker_windows.n_allocated = sizeof(marker_windows) / sizeof(marker_windows[0]);
+        g_marker_windows.n_used = g_embedded_n_markers;
+        for (int index = 0; index < g_embedded_n_markers; ++index) {
+            marker_windows[index].window = NULL;
+            marker_windows[index].x = g_embedded_markers[index][0];
+            marker_windows[index].y = g_embedded_markers[index][1];
+            marker_windows[index].w = g_embedded_markers[index][2];
+            marker_windows[index].h = g_embedded_markers[index][3];
+        }
+    }
+#endif
+
+    struct BatchItem {
+        OverlaySpec overlay;
+        OverlayAnalysis analysis;
+        const char *error;
+        int64_t decode_us;
+        int64_t analyze_us;
+    };
+
+    int64_t elapsed_us(LARGE_INTEGER *start)
+    {
+        LARGE_INTEGER now;
+        LARGE_INTEGER frequency;
+        (void)::QueryPerformanceCounter(&now);
+        (void)::QueryPerformanceFrequency(&frequency);
+        return (now.QuadPart - start->QuadPart) * 1000000 / frequency.QuadPart;
+    }
+
+    void analyze_batch_item_job(void *context, int index)
+    {
+        BatchItem *item = (BatchItem*)context + index;
+        item->analysis.overlay = &item->overlay;
+        LARGE_INTEGER start;
+        (void)::QueryPerformanceCounter(&start);
+        item->error = decode_overlay_image(&item->analysis);
+        item->decode_us = elapsed_us(&start);
+        if (item->error)
+            return;
+        (void)::QueryPerformanceCounter(&start);
+        for (int frame = 0; frame < item->analysis.n_frames; ++frame)
+            analyze_frame(&item->analysis, frame);
+        item->analyze_us = elapsed_us(&start);
+        stbi_image_free(item->analysis.pixels);
+        stbi_image_free(item->analysis.delays_ms);
+        item->analysis.pixels = nullptr;
+        item->analysis.delays_ms = nullptr;
+    }
+
+    struct BatchItemArray {
+        BatchItem *array;
+        int n_allocated;
+        int n_used;
+    };
+
+    void add_batch_item(BatchItemArray *items, char *filename)
+    {
+        if (items->n_used == items->n_allocated) {
+            items->n_allocated = items->n_allocated ? 2 * items->n_allocated : 64;
+            BatchItem *new_array = (BatchItem*)counted_realloc(items->array, items->n_allocated * sizeof(BatchItem));
+            if (!new_array)
+                exit_error("out of memory: could not grow batch item array");
+            items->array = new_array;
+        }
+        BatchItem *item = items->array + items->n_used++;
+        memset(item, 0, sizeof(*item));
+        item->overlay.filename = filename;
+    }
+
+    bool has_image_extension(char *filename)
+    {
+        char *dot = strrchr(filename, '.');
+        return dot && (_stricmp(dot, ".png") == 0 || _stricmp(dot, ".gif") == 0);
+    }
+
+    void collect_batch_items(char *path, BatchItemArray *items)
+    {
+        DWORD attributes = ::GetFileAttributes(path);
+        if (attributes == INVALID_FILE_ATTRIBUTES)
+            exit_windows_system_error("could not access '%s'", path);
+
+        if (attributes & FILE_ATTRIBUTE_DIRECTORY) {
+            size_t path_length = strlen(path);
+            char *pattern = (char*)counted_malloc(path_length + 3);
+            if (!pattern)
+                exit_error("out of memory: could not allocate directory search pattern");
+            memcpy(pattern, path, path_length);
+            memcpy(pattern + path_length, "\\*", 3);
+            WIN32_FIND_DATA find_data;
+            HANDLE find = ::FindFirstFile(pattern, &find_data);
+            if (find == INVALID_HANDLE_VALUE)
+                exit_windows_system_error("could not list directory '%s'", path);
+            do {
+                if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !has_image_extension(find_data.cFileName))
+                    continue;
+                size_t name_length = strlen(find_data.cFileName);
+                char *filename = (char*)counted_malloc(path_length + 1 + name_length + 1);
+                if (!filename)
+                    exit_error("out of memory: could not allocate filename");
+                memcpy(filename, path, path_length);
+                filename[path_length] = '\\';
+                memcpy(filename + path_length + 1, find_data.cFileName, name_length + 1);
+                add_batch_item(items, filename);
+            } while (::FindNextFile(find, &find_data));
+            if (::GetLastError() != ERROR_NO_MORE_FILES)
+                exit_windows_system_error("could not list directory '%s'", path);
+            (void)::FindClose(find);
+            free(pattern);
+            return;
+        }
+
+        int size;
+        char *list = (char*)read_entire_file(path, &size);
+        if (!list)
+            exit_clib_error("could not read list file '%s'", path);
+        char *line = list;
+        char *list_end = list + size;
+        while (line < list_end) {
+            char *line_end = line;
+            while (line_end < list_end && *line_end != '\n')
+                line_end++;
+            char *next_line = line_end + 1;
+            while (line_end > line && isspace(line_end[-1]))
+                line_end--;
+            while (line < line_end && isspace(*line))
+                line++;
+            if (line < line_end && *line != '#') {
+                size_t length = line_end - line;
+                char *filename = (char*)counted_malloc(length + 1);
+                if (!filename)
+                    exit_error("out of memory: could not allocate filename");
+                memcpy(filename, line, length);
+                filename[length] = 0;
+                add_batch_item(items, filename);
+            }
+            line = next_line;
+        }
+        free(list);
+    }
+
+    // XXX @Leak the batch items are not freed as we exit right afterwards
+    /**
+     * Run the batch analysis requested with --analyze and return the exit code.
+     */
+    int run_batch_analysis()
+    {
+        bool attached = false;
+        FILE *output = stdout;
+        if (g_analyze_output_filename) {
+            #pragma warning (suppress : 4996) // no need for fopen_s
+            output = fopen(g_analyze_output_filename, "w");
+            if (!output)
+                exit_clib_error("could not open output file '%s'", g_analyze_output_filename);
+        }
+        else
+            attached = attach_console();
+
+        BatchItemArray items = { 0 };
+        collect_batch_items(g_analyze_path, &items);
+
+        // the worker threads take the next image as soon as they are done with
+        // the previous one, so a few large images do not hold up the rest
+        run_parallel_jobs(items.n_used, analyze_batch_item_job, items.array);
+
+        int n_errors = 0;
+        for (int i = 0; i < items.n_used; ++i) {
+            BatchItem *item = items.array + i;
+            if (item->error) {
+                fprintf(output, "error \"%s\" %s\n", item->overlay.filename, item->error);
+                n_errors++;
+                continue;
+            }
+            OverlayAnalysis *analysis = &item->analysis;
+            fprintf(output, "image \"%s\" %dx%d frames %d decode_us %" PRId64 " analyze_us %" PRId64 "\n",
+                    item->overlay.filename, analysis->width, analysis->height, analysis->n_frames,
+                    item->decode_us, item->analyze_us);
+            for (int frame = 0; frame < analysis->n_frames; ++frame) {
+                MarkerWindowArray *markers = &analysis->frames[frame].markers;
+                fprintf(output, "frame %d regions %d markers %d eliminated %d\n", frame,
+                        analysis->frames[frame].n_regions, markers->n_used, analysis->frames[frame].n_eliminated);
+                for (int index = 0; index < markers->n_used; ++index) {
+                    MarkerWindow *marker = markers->array + index;
+                    fprintf(output, "%d %d %d %d\n", marker->x, marker->y, marker->w, marker->h);
+                }
+            }
+        }
+        if (output != stdout && fclose(output) != 0)
+            exit_clib_error("could not write output file '%s'", g_analyze_output_filename);
+        if (!g_analyze_output_filename && !attached)
+            prompt_for_console_key_press();
+        return n_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
+    HWND create_marker_window(HINSTANCE hInstance, ATOM window_class, int x, int y, int w, int h, bool visible)
+    {
+        HWND window = ::CreateWindowEx(
+                WS_EX_TOPMOST, // dwExStyle
+                reinterpret_cast<LPCTSTR>(window_class), // lpClassName
+                TEXT("Overhead Marker"), // lpWindowName
+                WS_POPUP | (visible ? WS_VISIBLE : 0), // dwStyle
+                x, y, w, h, // X, Y, nWidth, nHeight
+                g_main_window, // hWndParent
+                0, // hMenu
+                hInstance, // hInstance
+                NULL); // lpParam
+        if (!window)
+            exit_windows_system_error("could not create marker window");
+        return window;
+    }
+
+    void create_marker_windows(HINSTANCE hInstance, ATOM window_class)
+    {
+        for (int index = 0; index < g_marker_windows.n_used; ++index)
+        {
+            MarkerWindow *marker = g_marker_windows.array + index;
+            marker->window = create_marker_window(hInstance, window_class,
+                    marker->x, marker->y, marker->w, marker->h, true);
+        }
+
+        // animations get a fixed pool of windows which are rearranged for every frame
+        for (int i = 0; i < g_n_animations; ++i) {
+            AnimatedOverlay *animation = g_animations + i;
+            animation->windows = (HWND*)counted_malloc(max(animation->n_windows, 1) * sizeof(HWND));
+            if (!animation->windows)
+                exit_error("out of memory: could not allocate animation window array");
+            MarkerWindowArray *markers = &animation->frames[0].markers;
+            for (int index = 0; index < animation->n_windows; ++index) {
+                if (index < markers->n_used) {
+                    MarkerWindow *marker = markers->array + index;
+                    animation->windows[index] = create_marker_window(hInstance, window_class,
+                            marker->x, marker->y, marker->w, marker->h, true);
+                }
+                else
+                    animation->windows[index] = create_marker_window(hInstance, window_class,
+                            0, 0, 1, 1, false);
+            }
+        }
+    }
+        
+    void create_main_window(HINSTANCE hInstance, ATOM window_class)
+    {
+        HWND window = ::CreateWindowEx(
+                WS_EX_TOPMOST /* | WS_EX_LAYERED see :LayeredWindow */, // dwExStyle
+                reinterpret_cast<LPCTSTR>(window_class), // lpClassName
+                TEXT("Overhead Display"), // lpWindowName
+                WS_POPUP | WS_VISIBLE, // dwStyle
+                g_position_x, g_position_y, g_background_image_width, g_background_image_height, // X, Y, nWidth, nHeight
+                0, // hWndParent
+                0, // hMenu
+                hInstance, // hInstance
+                NULL); // lpParam
+        if (!window)
+            exit_windows_system_error("could not create main window");
+        g_main_window = window;
+
+        // XXX If only OBS would work with the compositing window manager, we could do so much nice
+        //     stuff with a layered window. :LayeredWindow
+        //     In the future, if we can assume Windows >= 8 and the DWM is running,
+        //     we might actually rather want to use DirectComposition.
+        //     See: http://www.pjblewis.com/site/posts/2016-04-27-p2-efficient-alpha-blended-windows-directcomposition.html
+#if 0
+        if (!::SetLayeredWindowAttributes(
+                    window, // hwnd,
+                    RGB(0, 0, 0), // crKey
+                    128, // bAlpha
+                    LWA_ALPHA /* | LWA_COLORKEY */)) // dwFlags
+            exit_windows_system_error("could not set layered window attributes");
+#endif
+    }
+
+    int64_t get_clock_tick_ms()
+    {
+        if (g_use_simulated_clock)
+            return g_simulated_clock_ms;
+        // the tick count only advances every ~16 ms, which is too coarse for
+        // waking up right when the displayed second flips
+        static LARGE_INTEGER frequency = { 0 };
+        if (!frequency.QuadPart)
+            (void)::QueryPerformanceFrequency(&frequency);
+        LARGE_INTEGER counter;
+        (void)::QueryPerformanceCounter(&counter);
+        return counter.QuadPart / frequency.QuadPart * 1000
+            + counter.QuadPart % frequency.QuadPart * 1000 / frequency.QuadPart;
+    }
+
+    int64_t calculate_displayed_ms()
+    {
+        if (g_clock_paused)
+            return g_clock_value_ms;
+        int64_t elapsed_ms = get_clock_tick_ms() - g_clock_reference_ms;
+        if (g_clock_mode == CLOCK_COUNT_UP)
+            return g_clock_value_ms + elapsed_ms;
+        return max(g_clock_value_ms - elapsed_ms, (int64_t)0);
+    }
+
+    /**
+     * Calculate the time to display.
+     *
+     * \return true if the displayed time is still changing (i.e. the clock is
+     *         neither paused nor an expired countdown).
+     */
+    bool calculate_displayed_time(SYSTEMTIME *displayed)
+    {
+        int64_t delta_ms = calculate_displayed_ms();
+        bool still_running = !g_clock_paused && (g_clock_mode == CLOCK_COUNT_UP || delta_ms > 0);
+        memset(displayed, 0, sizeof(*displayed));
+        displayed->wHour   = (WORD)(delta_ms  / (60 * 60 * 1000));
+        delta_ms -= displayed->wHour          * (60 * 60 * 1000);
+        displayed->wMinute = (WORD)(delta_ms  / (     60 * 1000));
+        delta_ms -= displayed->wMinute        * (     60 * 1000);
+        displayed->wSecond = (WORD)(delta_ms  / (          1000));
+        delta_ms -= displayed->wSecond        * (          1000);
+        displayed->wMilliseconds = (WORD)delta_ms;
+        return still_running;
+    }
+
+    void set_clock(ClockMode mode, int64_t value_ms)
+    {
+        g_clock_mode = mode;
+        g_clock_value_ms = max(value_ms, (int64_t)0);
+        g_clock_reference_ms = get_clock_tick_ms();
+    }
+
+    void reset_clock()
+    {
+        g_clock_paused = false;
+        set_clock(CLOCK_COUNT_DOWN, (int64_t)g_countdown_minutes * 60 * 1000);
+    }
+
+    /**
+     * Let timer expire once after delay_ms milliseconds, replacing any
+     * pending expiry.
+     */
+    void arm_timer(HANDLE timer, int64_t delay_ms)
+    {
+        LARGE_INTEGER due_time;
+        due_time.QuadPart = -max(delay_ms, (int64_t)1) * 10000; // relative time in units of 100 ns
+        if (!::SetWaitableTimer(
+                    timer, // hTimer
+                    &due_time, // lpDueTime
+                    0, // lPeriod (one-shot)
+                    NULL, // pfnCompletionRoutine
+                    NULL, // lpArgToCompletionRoutine
+                    FALSE)) // fResume
+            exit_windows_system_error("could not set timer");
+    }
+
+    void start_clock_timer()
+    {
+        // the timer handler re-arms the timer with the right delay
+        arm_timer(g_clock_timer, 0);
+    }
+
+    void start_animation_timer(int64_t now_ms)
+    {
+        if (!g_n_animations)
+            return;
+        int64_t next_ms = g_animations[0].next_frame_ms;
+        for (int i = 1; i < g_n_animations; ++i)
+            next_ms = min(next_ms, g_animations[i].next_frame_ms);
+        arm_timer(g_animation_timer, next_ms - now_ms);
+    }
+
+    void start_animations()
+    {
+        int64_t now_ms = get_clock_tick_ms();
+        for (int i = 0; i < g_n_animations; ++i)
+            g_animations[i].next_frame_ms = now_ms + g_animations[i].frames[0].delay_ms;
+        start_animation_timer(now_ms);
+    }
+
+    /**
+     * Advance all animations whose next frame is due by applying the
+     * precomputed window changes (so the cost is proportional to the change).
+     */
+    void advance_animations()
+    {
+        int64_t now_ms = get_clock_tick_ms();
+        for (int i = 0; i < g_n_animations; ++i) {
+            AnimatedOverlay *animation = g_animations + i;
+            // don't try to catch up if we fell far behind (e.g. after suspend)
+            if (now_ms - animation->next_frame_ms > 1000)
+                animation->next_frame_ms = now_ms;
+            while (now_ms >= animation->next_frame_ms) {
+                AnimationFrame *frame = animation->frames + animation->current_frame;
+                if (frame->n_deltas) {
+                    HDWP dwp = ::BeginDeferWindowPos(frame->n_deltas);
+                    for (int d = 0; dwp && d < frame->n_deltas; ++d) {
+                        MarkerDelta *delta = frame->deltas + d;
+                        UINT flags = SWP_NOZORDER | SWP_NOACTIVATE;
+                        if (delta->w)
+                            flags |= SWP_SHOWWINDOW;
+                        else
+                            flags |= SWP_HIDEWINDOW | SWP_NOMOVE | SWP_NOSIZE;
+                        dwp = ::DeferWindowPos(dwp, animation->windows[delta->index], NULL,
+                                delta->x, delta->y, delta->w, delta->h, flags);
+                    }
+                    if (!dwp || !::EndDeferWindowPos(dwp))
+                        exit_windows_system_error("could not update animated marker windows");
+                }
+                animation->current_frame = (animation->current_frame + 1) % animation->n_frames;
+                animation->next_frame_ms += animation->frames[animation->current_frame].delay_ms;
+            }
+        }
+        start_animation_timer(now_ms);
+    }
+
+    /**
+     * \note There are no sane conventions for parsing the command line on Windows.
+     *       We try to do something simple here that allows the user to specify
+     *       paths containing whitespace by using quotes in a way that is also
+     *       understood by DOS commands like 'dir'. For example, the following are
+     *       valid ways to specify the file 'back ground.png' in 'example directory':
+     *
+     *           overhead --background="example directory\back ground.png"
+     *           overhead --background="example directory"\"back ground.png"
+     *           overhead "--background=example directory\back ground.png"
+     *
+     *       and even the very ugly
+     *
+     *           overhead --background="example directory\"foo.png
+     *
+     *       (This last one is the reason why we cannot support backslash-escaped
+     *       quotes within quoted string arguments.)
+     *       Note also that quotes themselves are not allowed within
+     *       Windows filenames.
+     */
+    char *consume_and_dup_command_line_argument(char **cmdline)
+    {
+        // XXX @Incomplete extend this function for UNICODE
+
+        // skip leading whitespace
+        while (**cmdline && isspace(**cmdline))
+            (*cmdline)++;
+
+        if (!**cmdline)
+            return nullptr;
+
+        size_t maxsize = strlen(*cmdline) + 1;
+        char *arg = (char *)counted_malloc(maxsize);
+        if (!arg)
+            exit_error("out of memory: could not allocate space for command line argument\n");
+
+        char *arg_ptr = arg;
+        bool in_quotes = false;
+        while (true) {
             char ch = *(*cmdline)++;
             switch (ch) {
                 case '"':
@@ -628,7 +2307,8 @@ namespace {
         return arg;
     }
 
-    // XXX @Leak g_background_image_filename, g_overlay_image_filename are never freed
+    // XXX @Leak g_background_image_filename, g_overlays, g_control_pipe_name, g_shm_name,
+    //           g_analyze_path, g_analyze_output_filename, g_emit_assets_filename are never freed
     void parse_command_line(LPSTR cmdline)
     {
         // XXX @Incomplete extend this function for UNICODE
@@ -643,7 +2323,130 @@ namespace {
                 g_background_image_filename = _strdup(arg + 13);
             }
             else if (strncmp(arg, "--overlay=", 10) == 0) {
-                g_overlay_image_filename = _strdup(arg + 10);
+                // an optional '@X,Y' suffix specifies the screen offset of the overlay
+                // (a filename that merely contains an '@' is left alone if the suffix does not parse)
+                char *filename = _strdup(arg + 10);
+                if (!filename)
+                    exit_error("out of memory: could not duplicate overlay filename\n");
+                int offset_x = 0;
+                int offset_y = 0;
+                char *at = strrchr(filename, '@');
+                if (at) {
+                    char *parseend = nullptr;
+                    long value_x = strtol(at + 1, &parseend, 10);
+                    if (parseend != at + 1 && *parseend == ',') {
+                        char *comma = parseend;
+                        long value_y = strtol(comma + 1, &parseend, 10);
+                        if (parseend != comma + 1 && !*parseend) {
+                            if (value_x < INT_MIN || value_x > INT_MAX || value_y < INT_MIN || value_y > INT_MAX)
+                                exit_error("overlay offset is out of range: %s\n", arg);
+                            offset_x = (int)value_x;
+                            offset_y = (int)value_y;
+                            *at = 0;
+                        }
+                    }
+                }
+                add_overlay(filename, offset_x, offset_y);
+            }
+            else if (strncmp(arg, "--tolerance=", 12) == 0) {
+                char *parseend = nullptr;
+                long value = strtol(arg + 12, &parseend, 10);
+                if (parseend == arg + 12 || parseend != end)
+                    exit_error("outline tolerance did not parse as an integer: %s\n", arg);
+                if (value < 0 || value > 1000)
+                    exit_error("outline tolerance is out of range ([0; 1000] pixels expected)\n");
+                g_outline_tolerance = (int)value;
+            }
+            else if (strncmp(arg, "--scale=", 8) == 0) {
+                char *parseend = nullptr;
+                double value = strtod(arg + 8, &parseend);
+                if (parseend == arg + 8 || parseend != end)
+                    exit_error("scale factor did not parse as a number: %s\n", arg);
+                if (!(value > 0.0 && value <= 16.0))
+                    exit_error("scale factor is out of range ((0; 16] expected)\n");
+                g_overlay_scale = value;
+            }
+            else if (strncmp(arg, "--exclude=", 10) == 0) {
+                long values[4];
+                char *text = arg + 10;
+                for (int i = 0; i < 4; ++i) {
+                    char *parseend = nullptr;
+                    values[i] = strtol(text, &parseend, 10);
+                    if (parseend == text || (i < 3 ? (*parseend != ',') : (parseend != end)))
+                        exit_error("exclusion did not parse as X,Y,W,H: %s\n", arg);
+                    text = parseend + 1;
+                }
+                if (values[0] < -(1 << 24) || values[0] > (1 << 24) || values[1] < -(1 << 24) || values[1] > (1 << 24)
+                        || values[2] <= 0 || values[2] > (1 << 24) || values[3] <= 0 || values[3] > (1 << 24))
+                    exit_error("exclusion is out of range: %s\n", arg);
+                // grow the area by one pixel so that the marker lines along it stay outside
+                SpanRegion rect;
+                init_span_region_rect(&rect, (int)values[0] - 1, (int)values[1] - 1, (int)values[2] + 2, (int)values[3] + 2);
+                combine_span_regions_in_place(&g_exclusion, &rect, REGION_UNION);
+                free_span_region(&rect);
+            }
+            else if (strncmp(arg, "--target-size=", 14) == 0) {
+                char *parseend = nullptr;
+                long width = strtol(arg + 14, &parseend, 10);
+                if (parseend == arg + 14 || *parseend != 'x')
+                    exit_error("target size did not parse as WxH: %s\n", arg);
+                char *height_text = parseend + 1;
+                long height = strtol(height_text, &parseend, 10);
+                if (parseend == height_text || parseend != end)
+                    exit_error("target size did not parse as WxH: %s\n", arg);
+                if (width <= 0 || width > 65536 || height <= 0 || height > 65536)
+                    exit_error("target size is out of range ([1; 65536] expected)\n");
+                g_overlay_target_width = (int)width;
+                g_overlay_target_height = (int)height;
+            }
+            else if (strcmp(arg, "--shm") == 0) {
+                g_shm_name = OVERHEAD_SHM_DEFAULT_NAME;
+            }
+            else if (strncmp(arg, "--shm=", 6) == 0) {
+                if (!arg[6])
+                    exit_usage("empty shared memory name: %s\n", arg);
+                g_shm_name = _strdup(arg + 6);
+            }
+            else if (strncmp(arg, "--emit-assets=", 14) == 0) {
+                g_emit_assets_filename = _strdup(arg + 14);
+            }
+            else if (strncmp(arg, "--analyze=", 10) == 0) {
+                g_analyze_path = _strdup(arg + 10);
+            }
+            else if (strncmp(arg, "--analyze-output=", 17) == 0) {
+                g_analyze_output_filename = _strdup(arg + 17);
+            }
+            else if (strncmp(arg, "--soak=", 7) == 0) {
+                char *parseend = nullptr;
+                long long value = strtoll(arg + 7, &parseend, 10);
+                if (parseend == arg + 7 || parseend != end)
+                    exit_error("soak frame count did not parse as an integer: %s\n", arg);
+                if (value <= 0)
+                    exit_error("soak frame count must be positive\n");
+                g_soak_frames = value;
+            }
+            else if (strncmp(arg, "--soak-step=", 12) == 0) {
+                char *parseend = nullptr;
+                long value = strtol(arg + 12, &parseend, 10);
+                if (parseend == arg + 12 || parseend != end)
+                    exit_error("soak step did not parse as an integer: %s\n", arg);
+                if (value < 0 || value > 24 * 60 * 60 * 1000)
+                    exit_error("soak step is out of range ([0; 86400000] milliseconds expected)\n");
+                g_soak_step_ms = value;
+            }
+            else if (strcmp(arg, "--soak-realtime") == 0) {
+                g_soak_realtime = true;
+            }
+            else if (strcmp(arg, "--watch") == 0) {
+                g_watch_background = true;
+            }
+            else if (strcmp(arg, "--control") == 0) {
+                g_control_pipe_name = "overhead";
+            }
+            else if (strncmp(arg, "--control=", 10) == 0) {
+                if (!arg[10])
+                    exit_usage("empty pipe name: %s\n", arg);
+                g_control_pipe_name = _strdup(arg + 10);
             }
             else if (strncmp(arg, "--countdown=", 12) == 0) {
                 char *parseend = nullptr;
@@ -687,11 +2490,14 @@ namespace {
             free(arg);
         }
 
-        // default to zero size window if there is no countdown
+        // the clock can be started via the control pipe even without an initial countdown
+        g_show_clock = g_countdown_minutes || g_control_pipe_name || g_soak_frames;
+
+        // default to zero size window if there is no clock
         if (g_background_image_width < 0)
-            g_background_image_width = g_countdown_minutes ? 150 : 0;
+            g_background_image_width = g_show_clock ? 150 : 0;
         if (g_background_image_height < 0)
-            g_background_image_height = g_countdown_minutes ? 25 : 0;
+            g_background_image_height = g_show_clock ? 25 : 0;
     }
 
     // XXX @Leak the font is never deleted currently
@@ -716,32 +2522,58 @@ namespace {
             exit_windows_system_error("could not create logical font");
     }
 
-    void paint_countdown_window(HWND hWnd)
+    // position of the time within the timer window
+    constexpr int COUNTDOWN_TEXT_X = 5;
+    constexpr int COUNTDOWN_TEXT_Y = -3;
+
+    /**
+     * Format the displayed time into format_buf.
+     *
+     * \return the length of the text
+     */
+    int format_countdown_text(char *format_buf, size_t size)
     {
-#ifdef DEBUG_MEMORY_USE
+        SYSTEMTIME remaining;
+        int result;
+        calculate_displayed_time(&remaining);
+        if (g_countdown_minutes >= 60 || remaining.wHour)
+            result = snprintf(format_buf, size, "%2u:%02u:%02u", remaining.wHour, remaining.wMinute, remaining.wSecond);
+        else
+            result = snprintf(format_buf, size, "%02u:%02u", remaining.wMinute, remaining.wSecond);
+        if (result < 0)
+            exit_clib_error("snprintf failed");
+        if ((size_t)result >= size) {
+            result = (int)size - 1;
+            format_buf[result] = 0;
+        }
+        return result;
+    }
+
+    void draw_countdown_text(HDC memory_dc)
+    {
+        HFONT old_font;
+        COLORREF old_color;
+        COLORREF old_bk_color;
+        int old_bk_mode;
+        if (g_show_clock && g_font
+                && (old_font = (HFONT)::SelectObject(memory_dc, g_font))
+                && ((old_color = ::SetTextColor(memory_dc, RGB(255, 255, 255))) != CLR_INVALID)
+                && ((old_bk_color = ::SetBkColor(memory_dc, RGB(0, 0, 0))) != CLR_INVALID)
+                && ((old_bk_mode = ::SetBkMode(memory_dc, TRANSPARENT)) != 0)
+           )
         {
-            static uint64_t debug_count = 0;
-            static uint64_t last_changed = 0;
-            static uint64_t prev = 0;
-            PROCESS_MEMORY_COUNTERS mem = { 0 };
-            mem.cb = sizeof(mem);
-            if (::GetProcessMemoryInfo(::GetCurrentProcess(), &mem, mem.cb)) {
-                printf("%10" PRIu64 " (not changed for %10" PRIu64 ") mem: work %8zu peak %8zu\n",
-                        debug_count, debug_count - last_changed, mem.WorkingSetSize, mem.PeakWorkingSetSize);
-                if (mem.WorkingSetSize != prev) {
-                    prev = mem.WorkingSetSize;
-                    last_changed = debug_count;
-                }
-            }
-            debug_count++;
+            char format_buf[20];
+            int result = format_countdown_text(format_buf, sizeof(format_buf));
+            if (!::TextOut(memory_dc, COUNTDOWN_TEXT_X, COUNTDOWN_TEXT_Y, format_buf, result))
+                exit_windows_system_error("TextOut failed");
         }
-#endif
+    }
 
-        PAINTSTRUCT paint;
-        HDC dc = ::BeginPaint(hWnd, &paint);
-        if (!dc)
-            exit_windows_system_error("BeginPaint failed");
-        SYSTEMTIME remaining;
+    /**
+     * Render the timer (background and time) to the given device context.
+     */
+    void render_countdown_frame(HDC dc)
+    {
         HDC memory_dc;
         memory_dc = ::CreateCompatibleDC(dc);
         if (!memory_dc)
@@ -763,39 +2595,193 @@ namespace {
         if (!old_bitmap)
             exit_windows_system_error("could not select bitmap into memory device context");
         (void)::DeleteObject(old_bitmap);
-        HFONT old_font;
-        COLORREF old_color;
-        COLORREF old_bk_color;
-        int old_bk_mode;
-        if (g_countdown_minutes && g_font
-                && (old_font = (HFONT)::SelectObject(memory_dc, g_font))
-                && ((old_color = ::SetTextColor(memory_dc, RGB(255, 255, 255))) != CLR_INVALID)
-                && ((old_bk_color = ::SetBkColor(memory_dc, RGB(0, 0, 0))) != CLR_INVALID)
-                && ((old_bk_mode = ::SetBkMode(memory_dc, TRANSPARENT)) != 0)
-           )
-        {
-            char format_buf[20];
-            int result;
-            calculate_time_until_expiry(&remaining);
-            if (g_countdown_minutes >= 60)
-                result = snprintf(format_buf, sizeof(format_buf), "%2u:%02u:%02u", remaining.wHour, remaining.wMinute, remaining.wSecond);
-            else
-                result = snprintf(format_buf, sizeof(format_buf), "%02u:%02u", remaining.wMinute, remaining.wSecond);
-            if (result < 0)
-                exit_clib_error("snprintf failed");
-            if (result >= sizeof(format_buf)) {
-                result = sizeof(format_buf) - 1;
-                format_buf[result] = 0;
-            }
-            if (!::TextOut(memory_dc, 5, -3, format_buf, result))
-                exit_windows_system_error("TextOut failed");
+        draw_countdown_text(memory_dc);
+        if (!::BitBlt(dc, 0, 0, g_background_image_width, g_background_image_height,
+                    memory_dc, 0, 0, SRCCOPY))
+            exit_windows_system_error("bit block transfer failed");
+        (void)::DeleteDC(memory_dc);
+        if (!::DeleteObject(bitmap))
+            exit_windows_system_error("could not delete compatible bitmap");
+    }
+
+    /**
+     * The timer window keeps its contents in a DIB section which we draw into
+     * directly and which GDI can blit from without any conversion. Per update,
+     * only the rectangle covered by the old and the new text is restored from
+     * the background and redrawn, and only that rectangle is invalidated, so
+     * the full background is never pushed to the screen again after the first
+     * WM_PAINT.
+     *
+     * If the DIB sections cannot be created, we fall back to
+     * render_countdown_frame which renders the whole window for every paint.
+     */
+    struct CountdownSurface {
+        HDC dc; // NULL if we use the fallback
+        HBITMAP bitmap;
+        uint8_t *pixels; // bits of bitmap (32-bit BGRX, top-down)
+        HDC background_dc; // the background without text in the same format
+        HBITMAP background_bitmap;
+        char text[20]; // currently drawn text
+        int text_length;
+        RECT text_rect; // area covered by the currently drawn text
+    };
+
+    CountdownSurface g_countdown_surface;
+
+    HBITMAP create_countdown_dib_section(HDC dc, void **bits)
+    {
+        BITMAPINFO info = { 0 };
+        info.bmiHeader.biSize = sizeof(info.bmiHeader);
+        info.bmiHeader.biWidth = g_background_image_width;
+        info.bmiHeader.biHeight = -g_background_image_height; // negative means top-down storage
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+        return ::CreateDIBSection(dc, &info, DIB_RGB_COLORS, bits, NULL, 0);
+    }
+
+    // copy the current background image into the countdown surface (without text)
+    void fill_countdown_background()
+    {
+        CountdownSurface *surface = &g_countdown_surface;
+        HDC dc = surface->background_dc;
+        if (g_background_image_data) {
+            int result = ::SetDIBitsToDevice(dc,
+                    0, 0, // xDest, yDest
+                    g_background_image_width, g_background_image_height, // w, h
+                    0, 0, // xSrc, ySrc
+                    0, // StartScan
+                    g_background_image_height, // cLines
+                    g_background_image_data, // lpvBits
+                    &g_background_image_info, // lpbmi
+                    DIB_RGB_COLORS); // ColorUse
+            if (result != g_background_image_height)
+                exit_windows_system_error("could not copy background image data");
+        }
+        else if (!::PatBlt(dc, 0, 0, g_background_image_width, g_background_image_height, BLACKNESS))
+            exit_windows_system_error("could not clear countdown background");
+        if (!::BitBlt(surface->dc, 0, 0, g_background_image_width, g_background_image_height,
+                    dc, 0, 0, SRCCOPY))
+            exit_windows_system_error("could not copy countdown background");
+        surface->text_length = -1; // force drawing the text on the next update
+        (void)::SetRectEmpty(&surface->text_rect);
+    }
+
+    void create_countdown_surface()
+    {
+        CountdownSurface *surface = &g_countdown_surface;
+        if (g_background_image_width <= 0 || g_background_image_height <= 0)
+            return;
+        void *bits = nullptr;
+        void *background_bits = nullptr;
+        surface->dc = ::CreateCompatibleDC(NULL);
+        surface->background_dc = ::CreateCompatibleDC(NULL);
+        if (surface->dc && surface->background_dc) {
+            surface->bitmap = create_countdown_dib_section(surface->dc, &bits);
+            surface->background_bitmap = create_countdown_dib_section(surface->background_dc, &background_bits);
+        }
+        if (!surface->bitmap || !surface->background_bitmap
+                || !::SelectObject(surface->dc, surface->bitmap)
+                || !::SelectObject(surface->background_dc, surface->background_bitmap)) {
+            // use the fallback
+            if (surface->dc)
+                (void)::DeleteDC(surface->dc);
+            if (surface->background_dc)
+                (void)::DeleteDC(surface->background_dc);
+            if (surface->bitmap)
+                (void)::DeleteObject(surface->bitmap);
+            if (surface->background_bitmap)
+                (void)::DeleteObject(surface->background_bitmap);
+            memset(surface, 0, sizeof(*surface));
+            return;
+        }
+        surface->pixels = (uint8_t*)bits;
+        fill_countdown_background();
+
+        if (g_font
+                && (!::SelectObject(surface->dc, g_font)
+                    || ::SetTextColor(surface->dc, RGB(255, 255, 255)) == CLR_INVALID
+                    || ::SetBkMode(surface->dc, TRANSPARENT) == 0))
+            exit_windows_system_error("could not set up countdown text drawing");
+    }
+
+    /**
+     * Redraw the text in the countdown surface if it changed.
+     *
+     * \return true if anything changed; *dirty is then set to the changed area.
+     */
+    bool update_countdown_surface(RECT *dirty)
+    {
+        CountdownSurface *surface = &g_countdown_surface;
+        if (!surface->dc || !g_show_clock || !g_font)
+            return false;
+        char text[sizeof(surface->text)];
+        int length = format_countdown_text(text, sizeof(text));
+        if (length == surface->text_length && memcmp(text, surface->text, length) == 0)
+            return false;
+
+        SIZE extent;
+        if (!::GetTextExtentPoint32(surface->dc, text, length, &extent))
+            exit_windows_system_error("could not measure countdown text");
+        RECT text_rect;
+        RECT window_rect;
+        (void)::SetRect(&text_rect, COUNTDOWN_TEXT_X, COUNTDOWN_TEXT_Y,
+                COUNTDOWN_TEXT_X + extent.cx, COUNTDOWN_TEXT_Y + extent.cy);
+        (void)::SetRect(&window_rect, 0, 0, g_background_image_width, g_background_image_height);
+        (void)::IntersectRect(&text_rect, &text_rect, &window_rect);
+        (void)::UnionRect(dirty, &text_rect, &surface->text_rect);
+
+        if (!::BitBlt(surface->dc, dirty->left, dirty->top, dirty->right - dirty->left, dirty->bottom - dirty->top,
+                    surface->background_dc, dirty->left, dirty->top, SRCCOPY))
+            exit_windows_system_error("could not restore countdown background");
+        if (!::TextOut(surface->dc, COUNTDOWN_TEXT_X, COUNTDOWN_TEXT_Y, text, length))
+            exit_windows_system_error("TextOut failed");
+        memcpy(surface->text, text, length);
+        surface->text_length = length;
+        surface->text_rect = text_rect;
+        return true;
+    }
+
+    /**
+     * Paint the given area of the timer window to dc.
+     */
+    void paint_countdown_rect(HDC dc, const RECT *rect)
+    {
+        if (!g_countdown_surface.dc) {
+            render_countdown_frame(dc);
+            return;
         }
-        if (!::BitBlt(dc, 0, 0, g_background_image_width, g_background_image_height,
-                    memory_dc, 0, 0, SRCCOPY))
+        if (!::BitBlt(dc, rect->left, rect->top, rect->right - rect->left, rect->bottom - rect->top,
+                    g_countdown_surface.dc, rect->left, rect->top, SRCCOPY))
             exit_windows_system_error("bit block transfer failed");
-        (void)::DeleteDC(memory_dc);
-        if (!::DeleteObject(bitmap))
-            exit_windows_system_error("could not delete compatible bitmap");
+    }
+
+    void paint_countdown_window(HWND hWnd)
+    {
+#ifdef DEBUG_MEMORY_USE
+        {
+            static uint64_t debug_count = 0;
+            static uint64_t last_changed = 0;
+            static uint64_t prev = 0;
+            PROCESS_MEMORY_COUNTERS mem = { 0 };
+            mem.cb = sizeof(mem);
+            if (::GetProcessMemoryInfo(::GetCurrentProcess(), &mem, mem.cb)) {
+                printf("%10" PRIu64 " (not changed for %10" PRIu64 ") mem: work %8zu peak %8zu\n",
+                        debug_count, debug_count - last_changed, mem.WorkingSetSize, mem.PeakWorkingSetSize);
+                if (mem.WorkingSetSize != prev) {
+                    prev = mem.WorkingSetSize;
+                    last_changed = debug_count;
+                }
+            }
+            debug_count++;
+        }
+#endif
+
+        PAINTSTRUCT paint;
+        HDC dc = ::BeginPaint(hWnd, &paint);
+        if (!dc)
+            exit_windows_system_error("BeginPaint failed");
+        paint_countdown_rect(dc, &paint.rcPaint);
         (void)::EndPaint(hWnd, &paint);
     }
 
@@ -817,6 +2803,379 @@ namespace {
         (void)::EndPaint(hWnd, &paint);
     }
 
+    struct SharedFrameOutput {
+        HANDLE mapping;
+        uint8_t *view;
+        OverheadShmHeader *header;
+        HDC dc;
+        HBITMAP bitmap;
+        uint8_t *pixels; // bits of the DIB section selected into dc
+    };
+
+    SharedFrameOutput g_shared_frames;
+
+    void create_shared_frame_output()
+    {
+        if (!g_shm_name)
+            return;
+        if (g_background_image_width <= 0 || g_background_image_height <= 0)
+            exit_error("--shm requires a timer window of non-zero size\n");
+
+        uint32_t n_slots = 3;
+        uint32_t width = (uint32_t)g_background_image_width;
+        uint32_t height = (uint32_t)g_background_image_height;
+        uint32_t stride = width * 4;
+        uint32_t marker_offset = sizeof(OverheadShmHeader);
+        uint32_t n_markers = (uint32_t)g_marker_windows.n_used;
+        uint32_t slot_offset = marker_offset + n_markers * sizeof(OverheadShmMarker);
+        slot_offset = (slot_offset + 63) & ~63u;
+        uint64_t slot_size = (sizeof(OverheadShmSlot) + (uint64_t)stride * height + 63) & ~(uint64_t)63;
+        uint64_t size = slot_offset + n_slots * slot_size;
+        if (size > UINT32_MAX)
+            exit_error("shared frame buffer would be too large\n");
+
+        char mapping_name[MAX_PATH];
+        int result = snprintf(mapping_name, sizeof(mapping_name), "Local\\%s", g_shm_name);
+        if (result < 0 || (size_t)result >= sizeof(mapping_name))
+            exit_error("shared memory name is too long: %s\n", g_shm_name);
+        g_shared_frames.mapping = ::CreateFileMapping(
+                INVALID_HANDLE_VALUE, // hFile (backed by the paging file)
+                NULL, // lpFileMappingAttributes
+                PAGE_READWRITE, // flProtect
+                0, // dwMaximumSizeHigh
+                (DWORD)size, // dwMaximumSizeLow
+                mapping_name); // lpName
+        if (!g_shared_frames.mapping)
+            exit_windows_system_error("could not create shared memory '%s'", mapping_name);
+        if (::GetLastError() == ERROR_ALREADY_EXISTS)
+            exit_error("shared memory '%s' already exists (is another overhead running?)\n", mapping_name);
+        g_shared_frames.view = (uint8_t*)::MapViewOfFile(g_shared_frames.mapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)size);
+        if (!g_shared_frames.view)
+            exit_windows_system_error("could not map shared memory '%s'", mapping_name);
+
+        OverheadShmHeader *header = (OverheadShmHeader*)g_shared_frames.view;
+        header->version = OVERHEAD_SHM_VERSION;
+        header->width = width;
+        header->height = height;
+        header->stride = stride;
+        header->n_slots = n_slots;
+        header->slot_offset = slot_offset;
+        header->slot_size = (uint32_t)slot_size;
+        header->marker_offset = marker_offset;
+        header->n_markers = n_markers;
+        header->latest_sequence = 0;
+        OverheadShmMarker *markers = (OverheadShmMarker*)(g_shared_frames.view + marker_offset);
+        for (uint32_t i = 0; i < n_markers; ++i) {
+            markers[i].x = g_marker_windows.array[i].x;
+            markers[i].y = g_marker_windows.array[i].y;
+            markers[i].w = g_marker_windows.array[i].w;
+            markers[i].h = g_marker_windows.array[i].h;
+        }
+        // readers check the magic last
+        ::MemoryBarrier();
+        header->magic = OVERHEAD_SHM_MAGIC;
+        g_shared_frames.header = header;
+
+        // the countdown surface already has the pixels of the frame
+        if (g_countdown_surface.pixels)
+            return;
+
+        // frames are rendered into a DIB section so that we can get at the pixels
+        BITMAPINFO info = { 0 };
+        info.bmiHeader.biSize = sizeof(info.bmiHeader);
+        info.bmiHeader.biWidth = (LONG)width;
+        info.bmiHeader.biHeight = -(LONG)height; // negative means top-down storage
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+        g_shared_frames.dc = ::CreateCompatibleDC(NULL);
+        if (!g_shared_frames.dc)
+            exit_windows_system_error("could not create memory device context for shared frames");
+        void *bits = nullptr;
+        g_shared_frames.bitmap = ::CreateDIBSection(g_shared_frames.dc, &info, DIB_RGB_COLORS, &bits, NULL, 0);
+        if (!g_shared_frames.bitmap)
+            exit_windows_system_error("could not create DIB section for shared frames");
+        g_shared_frames.pixels = (uint8_t*)bits;
+        if (!::SelectObject(g_shared_frames.dc, g_shared_frames.bitmap))
+            exit_windows_system_error("could not select DIB section into memory device context");
+    }
+
+    /**
+     * Publish the current state of the timer as the next frame in the shared
+     * memory ring buffer (see overhead_shm.h for the protocol).
+     *
+     * \note With a countdown surface, the frame is copied straight from its
+     *       pixels, so update_countdown_surface must have been called before.
+     */
+    void publish_shared_frame()
+    {
+        OverheadShmHeader *header = g_shared_frames.header;
+        if (!header)
+            return;
+        uint8_t *pixels = g_countdown_surface.pixels;
+        if (!pixels) {
+            HDC dc = g_shared_frames.dc;
+            if (g_background_image_data) {
+                int result = ::SetDIBitsToDevice(dc,
+                        0, 0, // xDest, yDest
+                        g_background_image_width, g_background_image_height, // w, h
+                        0, 0, // xSrc, ySrc
+                        0, // StartScan
+                        g_background_image_height, // cLines
+                        g_background_image_data, // lpvBits
+                        &g_background_image_info, // lpbmi
+                        DIB_RGB_COLORS); // ColorUse
+                if (result != g_background_image_height)
+                    exit_windows_system_error("could not copy background image data");
+            }
+            else if (!::PatBlt(dc, 0, 0, g_background_image_width, g_background_image_height, BLACKNESS))
+                exit_windows_system_error("could not clear shared frame");
+            draw_countdown_text(dc);
+            pixels = g_shared_frames.pixels;
+        }
+        (void)::GdiFlush(); // make sure GDI is done writing to the DIB section
+
+        uint64_t sequence = header->latest_sequence + 1;
+        OverheadShmSlot *slot = (OverheadShmSlot*)(g_shared_frames.view + header->slot_offset
+                + (sequence % header->n_slots) * header->slot_size);
+        slot->sequence = 0;
+        ::MemoryBarrier();
+        memcpy(slot + 1, pixels, (size_t)header->stride * header->height);
+        ::MemoryBarrier();
+        slot->sequence = sequence;
+        header->latest_sequence = sequence;
+    }
+
+    /**
+     * Bring the timer window and the shared frames up to date with the clock.
+     */
+    /**
+     * Bring the countdown surface and the shared frames up to date with the clock.
+     *
+     * \return true if anything changed; *dirty is then set to the area of the
+     *         timer window that must be repainted.
+     */
+    bool update_countdown_frame(RECT *dirty)
+    {
+        if (g_countdown_surface.dc) {
+            if (!update_countdown_surface(dirty))
+                return false;
+        }
+        else
+            (void)::SetRect(dirty, 0, 0, g_background_image_width, g_background_image_height);
+        publish_shared_frame();
+        return true;
+    }
+
+    /**
+     * Bring the timer window and the shared frames up to date with the clock.
+     */
+    void refresh_countdown()
+    {
+        RECT dirty;
+        if (!update_countdown_frame(&dirty))
+            return;
+        if (!::InvalidateRect(g_main_window, &dirty, FALSE))
+            exit_windows_system_error("InvalidateRect failed");
+    }
+
+    struct SoakSnapshot {
+        uint64_t n_heap_blocks;
+        uint64_t heap_bytes;
+        uint64_t private_bytes;
+        DWORD n_gdi_objects;
+        DWORD n_user_objects;
+        DWORD n_handles;
+        int64_t n_allocations; // since the start of the program
+    };
+
+    // growth that we tolerate between the end of the warm-up and the end of the soak test
+    constexpr uint64_t SOAK_MAX_HEAP_BLOCK_GROWTH = 0;
+    constexpr uint64_t SOAK_MAX_PRIVATE_BYTES_GROWTH = 1024 * 1024; // page-granular, so allow some noise
+
+    // frame latencies are collected in a histogram with one bucket per microsecond
+    constexpr int SOAK_HISTOGRAM_SIZE = 100000; // the last bucket collects everything above
+
+    void take_soak_snapshot(SoakSnapshot *snapshot)
+    {
+        memset(snapshot, 0, sizeof(*snapshot));
+        // the C run-time library allocates from the process heap
+        HANDLE heap = ::GetProcessHeap();
+        if (!::HeapLock(heap))
+            exit_windows_system_error("could not lock process heap");
+        PROCESS_HEAP_ENTRY entry;
+        entry.lpData = NULL;
+        while (::HeapWalk(heap, &entry)) {
+            if (entry.wFlags & PROCESS_HEAP_ENTRY_BUSY) {
+                snapshot->n_heap_blocks++;
+                snapshot->heap_bytes += entry.cbData;
+            }
+        }
+        (void)::HeapUnlock(heap);
+
+        PROCESS_MEMORY_COUNTERS_EX mem = { 0 };
+        mem.cb = sizeof(mem);
+        if (!::GetProcessMemoryInfo(::GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&mem, mem.cb))
+            exit_windows_system_error("could not get process memory info");
+        snapshot->private_bytes = mem.PrivateUsage;
+        snapshot->n_gdi_objects = ::GetGuiResources(::GetCurrentProcess(), GR_GDIOBJECTS);
+        snapshot->n_user_objects = ::GetGuiResources(::GetCurrentProcess(), GR_USEROBJECTS);
+        if (!::GetProcessHandleCount(::GetCurrentProcess(), &snapshot->n_handles))
+            exit_windows_system_error("could not get process handle count");
+        snapshot->n_allocations = g_n_allocations;
+    }
+
+    void print_soak_snapshot(char *label, int64_t frame, SoakSnapshot *snapshot)
+    {
+        printf("%-8s frame %12" PRId64 ": heap %8" PRIu64 " blocks %10" PRIu64 " bytes, private %10" PRIu64 " bytes, "
+                "GDI %5lu, USER %5lu, handles %5lu, allocations %10" PRId64 "\n",
+                label, frame, snapshot->n_heap_blocks, snapshot->heap_bytes, snapshot->private_bytes,
+                snapshot->n_gdi_objects, snapshot->n_user_objects, snapshot->n_handles, snapshot->n_allocations);
+        fflush(stdout);
+    }
+
+    int latency_percentile_us(uint32_t *histogram, int64_t n_frames, double percentile)
+    {
+        int64_t rank = (int64_t)(percentile / 100.0 * (double)(n_frames - 1));
+        int64_t count = 0;
+        for (int us = 0; us < SOAK_HISTOGRAM_SIZE; ++us) {
+            count += histogram[us];
+            if (count > rank)
+                return us;
+        }
+        return SOAK_HISTOGRAM_SIZE - 1;
+    }
+
+    bool check_soak_growth(char *what, uint64_t before, uint64_t after, uint64_t max_growth)
+    {
+        if (after <= before + max_growth)
+            return true;
+        printf("FAIL: %s grew from %" PRIu64 " to %" PRIu64 "\n", what, before, after);
+        return false;
+    }
+
+    /**
+     * Run the headless soak test requested with --soak and return the exit code.
+     *
+     * Every frame goes through update_countdown_frame and paint_countdown_rect
+     * exactly like a clock tick and the following WM_PAINT of the timer window,
+     * but paints into a memory device context instead of a window.
+     */
+    int run_soak_test()
+    {
+        bool attached = attach_console();
+
+        g_use_simulated_clock = true;
+        g_simulated_clock_ms = 0;
+        if (g_countdown_minutes)
+            reset_clock();
+        else
+            set_clock(CLOCK_COUNT_UP, 0);
+
+        HDC screen_dc = ::GetDC(NULL);
+        if (!screen_dc)
+            exit_windows_system_error("could not get screen device context");
+        HDC target_dc = ::CreateCompatibleDC(screen_dc);
+        if (!target_dc)
+            exit_windows_system_error("could not create memory device context for soak test");
+        HBITMAP target_bitmap = ::CreateCompatibleBitmap(screen_dc, max(g_background_image_width, 1), max(g_background_image_height, 1));
+        if (!target_bitmap)
+            exit_windows_system_error("could not create bitmap for soak test");
+        if (!::SelectObject(target_dc, target_bitmap))
+            exit_windows_system_error("could not select bitmap into memory device context");
+
+        uint32_t *histogram = (uint32_t*)counted_calloc(SOAK_HISTOGRAM_SIZE, sizeof(uint32_t));
+        if (!histogram)
+            exit_error("out of memory: could not allocate latency histogram");
+        LARGE_INTEGER frequency;
+        LARGE_INTEGER start;
+        (void)::QueryPerformanceFrequency(&frequency);
+        (void)::QueryPerformanceCounter(&start);
+
+        int64_t n_frames = g_soak_frames;
+        int64_t n_warmup_frames = min(n_frames / 10, (int64_t)1000);
+        int64_t progress_interval = max(n_frames / 10, (int64_t)1);
+        SoakSnapshot baseline;
+        SoakSnapshot snapshot;
+        take_soak_snapshot(&baseline);
+        print_soak_snapshot("start", 0, &baseline);
+
+        for (int64_t frame = 0; frame < n_frames; ++frame) {
+            if (frame == n_warmup_frames) {
+                take_soak_snapshot(&baseline);
+                print_soak_snapshot("warm", frame, &baseline);
+            }
+            else if (frame > n_warmup_frames && frame % progress_interval == 0) {
+                take_soak_snapshot(&snapshot);
+                print_soak_snapshot("progress", frame, &snapshot);
+            }
+
+            g_simulated_clock_ms += g_soak_step_ms;
+            // restart an expired countdown so that every frame still renders a new time
+            if (g_clock_mode == CLOCK_COUNT_DOWN && calculate_displayed_ms() == 0)
+                reset_clock();
+            LARGE_INTEGER before;
+            (void)::QueryPerformanceCounter(&before);
+            if (g_soak_realtime) {
+                // wait until the wall clock catches up with the simulated clock
+                int64_t elapsed_ms = (before.QuadPart - start.QuadPart) * 1000 / frequency.QuadPart;
+                if (g_simulated_clock_ms > elapsed_ms) {
+                    ::Sleep((DWORD)(g_simulated_clock_ms - elapsed_ms));
+                    (void)::QueryPerformanceCounter(&before);
+                }
+            }
+
+            RECT dirty;
+            if (update_countdown_frame(&dirty))
+                paint_countdown_rect(target_dc, &dirty);
+            (void)::GdiFlush();
+
+            LARGE_INTEGER after;
+            (void)::QueryPerformanceCounter(&after);
+            int64_t latency_us = (after.QuadPart - before.QuadPart) * 1000000 / frequency.QuadPart;
+            histogram[min(latency_us, (int64_t)SOAK_HISTOGRAM_SIZE - 1)]++;
+        }
+
+        LARGE_INTEGER finish;
+        (void)::QueryPerformanceCounter(&finish);
+        take_soak_snapshot(&snapshot);
+        print_soak_snapshot("end", n_frames, &snapshot);
+
+        double seconds = (double)(finish.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+        printf("%" PRId64 " frames in %.3f s (%.0f frames/s)\n", n_frames, seconds, n_frames / seconds);
+        printf("frame latency [us]: p50 %d, p90 %d, p99 %d, p99.9 %d, max %d%s\n",
+                latency_percentile_us(histogram, n_frames, 50.0),
+                latency_percentile_us(histogram, n_frames, 90.0),
+                latency_percentile_us(histogram, n_frames, 99.0),
+                latency_percentile_us(histogram, n_frames, 99.9),
+                latency_percentile_us(histogram, n_frames, 100.0),
+                histogram[SOAK_HISTOGRAM_SIZE - 1] ? " (or more)" : "");
+
+        // heap snapshots only see blocks that are still alive, so we also
+        // count the allocations themselves to catch malloc/free pairs per frame
+        int64_t n_measured_frames = n_frames - n_warmup_frames;
+        int64_t n_allocations = snapshot.n_allocations - baseline.n_allocations;
+        printf("allocations after warm-up: %" PRId64 " (%.3f per frame)\n", n_allocations,
+                n_measured_frames ? (double)n_allocations / (double)n_measured_frames : 0.0);
+
+        bool ok = true;
+        ok &= check_soak_growth("allocation count", baseline.n_allocations, snapshot.n_allocations, 0);
+        ok &= check_soak_growth("heap block count", baseline.n_heap_blocks, snapshot.n_heap_blocks, SOAK_MAX_HEAP_BLOCK_GROWTH);
+        ok &= check_soak_growth("private bytes", baseline.private_bytes, snapshot.private_bytes, SOAK_MAX_PRIVATE_BYTES_GROWTH);
+        ok &= check_soak_growth("GDI object count", baseline.n_gdi_objects, snapshot.n_gdi_objects, 0);
+        ok &= check_soak_growth("USER object count", baseline.n_user_objects, snapshot.n_user_objects, 0);
+        ok &= check_soak_growth("handle count", baseline.n_handles, snapshot.n_handles, 0);
+        printf("%s\n", ok ? "PASS" : "FAIL");
+
+        free(histogram);
+        (void)::DeleteDC(target_dc);
+        (void)::DeleteObject(target_bitmap);
+        (void)::ReleaseDC(NULL, screen_dc);
+        if (!attached)
+            prompt_for_console_key_press();
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     ATOM register_window_class(HINSTANCE hInstance, WNDPROC wndproc)
     {
         WNDCLASS wc = {0}; 
@@ -830,12 +3189,452 @@ namespace {
         return window_class;
     }
 
-    void set_expiry_time()
+    /**
+     * Parse a DURATION argument of a control command (MINUTES or MINUTES:SECONDS).
+     */
+    bool parse_duration_ms(char *text, int64_t *duration_ms)
+    {
+        char *parseend = nullptr;
+        long minutes = strtol(text, &parseend, 10);
+        if (parseend == text || minutes < 0 || minutes >= 1440)
+            return false;
+        long seconds = 0;
+        if (*parseend == ':') {
+            char *seconds_text = parseend + 1;
+            seconds = strtol(seconds_text, &parseend, 10);
+            if (parseend == seconds_text || seconds < 0 || seconds >= 60)
+                return false;
+        }
+        while (isspace(*parseend))
+            parseend++;
+        if (*parseend)
+            return false;
+        *duration_ms = ((int64_t)minutes * 60 + seconds) * 1000;
+        return true;
+    }
+
+    /**
+     * Execute a single command line received via the control pipe.
+     * Invalid commands are ignored because there is nobody to report them to.
+     */
+    void execute_control_command(char *line)
+    {
+        while (isspace(*line))
+            line++;
+        char *command = line;
+        while (*line && !isspace(*line))
+            line++;
+        if (*line)
+            *line++ = 0;
+        while (isspace(*line))
+            line++;
+        char *argument = line;
+
+        int64_t duration_ms;
+        if (strcmp(command, "set") == 0) {
+            if (!parse_duration_ms(argument, &duration_ms))
+                return;
+            set_clock(CLOCK_COUNT_DOWN, duration_ms);
+        }
+        else if (strcmp(command, "add") == 0 || strcmp(command, "sub") == 0) {
+            if (!parse_duration_ms(argument, &duration_ms))
+                return;
+            if (command[0] == 's')
+                duration_ms = -duration_ms;
+            set_clock(g_clock_mode, calculate_displayed_ms() + duration_ms);
+        }
+        else if (strcmp(command, "pause") == 0) {
+            if (g_clock_paused)
+                return;
+            set_clock(g_clock_mode, calculate_displayed_ms());
+            g_clock_paused = true;
+        }
+        else if (strcmp(command, "resume") == 0) {
+            if (!g_clock_paused)
+                return;
+            g_clock_paused = false;
+            g_clock_reference_ms = get_clock_tick_ms();
+        }
+        else if (strcmp(command, "reset") == 0) {
+            reset_clock();
+        }
+        else if (strcmp(command, "up") == 0) {
+            set_clock(CLOCK_COUNT_UP, calculate_displayed_ms());
+        }
+        else
+            return;
+
+        start_clock_timer();
+        refresh_countdown();
+    }
+
+    struct ControlPipe {
+        HANDLE pipe;
+        HANDLE event; // signaled when the pending connect or read operation completes
+        OVERLAPPED overlapped;
+        bool connected;
+        DWORD n_buffered;
+        char buffer[256];
+    };
+
+    ControlPipe g_control;
+
+    void start_control_pipe_connect()
+    {
+        g_control.connected = false;
+        g_control.n_buffered = 0;
+        memset(&g_control.overlapped, 0, sizeof(g_control.overlapped));
+        g_control.overlapped.hEvent = g_control.event;
+        if (::ConnectNamedPipe(g_control.pipe, &g_control.overlapped))
+            return;
+        DWORD error = ::GetLastError();
+        if (error == ERROR_PIPE_CONNECTED) {
+            // the client connected between CreateNamedPipe/DisconnectNamedPipe and ConnectNamedPipe
+            if (!::SetEvent(g_control.event))
+                exit_windows_system_error("could not signal control pipe event");
+        }
+        else if (error != ERROR_IO_PENDING)
+            exit_windows_system_error("could not wait for connections on control pipe");
+    }
+
+    void restart_control_pipe_connect()
+    {
+        (void)::DisconnectNamedPipe(g_control.pipe);
+        start_control_pipe_connect();
+    }
+
+    void start_control_pipe_read()
+    {
+        if (g_control.n_buffered == sizeof(g_control.buffer) - 1)
+            g_control.n_buffered = 0; // overlong line, drop it
+        memset(&g_control.overlapped, 0, sizeof(g_control.overlapped));
+        g_control.overlapped.hEvent = g_control.event;
+        // even if ReadFile completes immediately, the event is signaled and
+        // we pick up the data in service_control_pipe
+        if (::ReadFile(g_control.pipe,
+                    g_control.buffer + g_control.n_buffered,
+                    sizeof(g_control.buffer) - 1 - g_control.n_buffered,
+                    NULL, &g_control.overlapped))
+            return;
+        DWORD error = ::GetLastError();
+        if (error == ERROR_BROKEN_PIPE)
+            restart_control_pipe_connect();
+        else if (error != ERROR_IO_PENDING)
+            exit_windows_system_error("could not read from control pipe");
+    }
+
+    void create_control_pipe()
+    {
+        if (!g_control_pipe_name)
+            return;
+        char pipe_path[MAX_PATH];
+        int result = snprintf(pipe_path, sizeof(pipe_path), "\\\\.\\pipe\\%s", g_control_pipe_name);
+        if (result < 0 || (size_t)result >= sizeof(pipe_path))
+            exit_error("control pipe name is too long: %s\n", g_control_pipe_name);
+        g_control.event = ::CreateEvent(
+                NULL, // lpEventAttributes
+                TRUE, // bManualReset
+                FALSE, // bInitialState
+                NULL); // lpName
+        if (!g_control.event)
+            exit_windows_system_error("could not create control pipe event");
+        g_control.pipe = ::CreateNamedPipe(
+                pipe_path, // lpName
+                PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE, // dwOpenMode
+                PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, // dwPipeMode
+                1, // nMaxInstances
+                0, // nOutBufferSize
+                sizeof(g_control.buffer), // nInBufferSize
+                0, // nDefaultTimeOut
+                NULL); // lpSecurityAttributes
+        if (g_control.pipe == INVALID_HANDLE_VALUE)
+            exit_windows_system_error("could not create control pipe '%s'", pipe_path);
+        start_control_pipe_connect();
+    }
+
+    /**
+     * Handle completion of the pending operation on the control pipe.
+     * Call this when g_control.event is signaled.
+     */
+    void service_control_pipe()
+    {
+        DWORD n_transferred = 0;
+        bool ok = ::GetOverlappedResult(g_control.pipe, &g_control.overlapped, &n_transferred, FALSE);
+        if (!::ResetEvent(g_control.event))
+            exit_windows_system_error("could not reset control pipe event");
+        if (!g_control.connected) {
+            if (!ok) {
+                restart_control_pipe_connect();
+                return;
+            }
+            g_control.connected = true;
+            start_control_pipe_read();
+            return;
+        }
+        if (!ok) {
+            // usually ERROR_BROKEN_PIPE when the client closed its end
+            restart_control_pipe_connect();
+            return;
+        }
+
+        g_control.n_buffered += n_transferred;
+        assert(g_control.n_buffered < sizeof(g_control.buffer));
+        g_control.buffer[g_control.n_buffered] = 0;
+        char *line = g_control.buffer;
+        char *newline;
+        while ((newline = strpbrk(line, "\r\n"))) {
+            *newline = 0;
+            execute_control_command(line);
+            line = newline + 1;
+        }
+        // keep the incomplete last line for the next read
+        g_control.n_buffered -= (DWORD)(line - g_control.buffer);
+        memmove(g_control.buffer, line, g_control.n_buffered);
+        start_control_pipe_read();
+    }
+
+    void handle_clock_timer()
+    {
+        SYSTEMTIME displayed;
+        if (calculate_displayed_time(&displayed)) {
+            // set the next timer expiry right after the second flips
+            int64_t delay_ms = (g_clock_mode == CLOCK_COUNT_UP) ? (1000 - displayed.wMilliseconds) : (displayed.wMilliseconds + 1);
+#ifdef DEBUG_MEMORY_USE
+            delay_ms = USER_TIMER_MINIMUM; // stress the paint function
+#endif
+            arm_timer(g_clock_timer, delay_ms);
+        }
+        refresh_countdown();
+    }
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+    HANDLE create_timer()
+    {
+        // high resolution timers (Windows 10 1803+) are not tied to the
+        // system timer interval, so we wake up when the deadline is due
+        HANDLE timer = ::CreateWaitableTimerEx(
+                NULL, // lpTimerAttributes
+                NULL, // lpTimerName
+                CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, // dwFlags (auto-reset)
+                TIMER_ALL_ACCESS); // dwDesiredAccess
+        if (!timer)
+            timer = ::CreateWaitableTimer(
+                    NULL, // lpTimerAttributes
+                    FALSE, // bManualReset
+                    NULL); // lpTimerName
+        if (!timer)
+            exit_windows_system_error("could not create timer");
+        return timer;
+    }
+
+    void create_timers()
+    {
+        g_clock_timer = create_timer();
+        g_animation_timer = create_timer();
+    }
+
+    HANDLE g_background_watch = INVALID_HANDLE_VALUE;
+
+    // decoding a large image takes long enough to delay the countdown,
+    // so --watch decodes on a worker thread and swaps the result in from
+    // the event loop
+    struct BackgroundReload {
+        HANDLE done; // signaled when the worker thread has finished
+        HANDLE thread; // NULL while no decode is running
+        bool pending; // the directory changed again while decoding
+        FILETIME write_time; // of the file being decoded
+        uint8_t *data;
+        int image_width;
+        int image_height;
+        const char *error;
+    };
+
+    BackgroundReload g_background_reload;
+
+    void create_background_watch()
+    {
+        if (!g_watch_background || !g_background_image_filename)
+            return;
+        // we can only watch directories, so watch the one containing the image
+        char directory[MAX_PATH];
+        char *file_part = nullptr;
+        DWORD length = ::GetFullPathName(g_background_image_filename, sizeof(directory), directory, &file_part);
+        if (!length || length >= sizeof(directory) || !file_part)
+            exit_windows_system_error("could not determine directory of '%s'", g_background_image_filename);
+        *file_part = 0;
+        g_background_watch = ::FindFirstChangeNotification(
+                directory, // lpPathName
+                FALSE, // bWatchSubtree
+                FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME); // dwNotifyFilter (editors may save by renaming)
+        if (g_background_watch == INVALID_HANDLE_VALUE)
+            exit_windows_system_error("could not watch directory '%s'", directory);
+        g_background_reload.done = ::CreateEvent(
+                NULL, // lpEventAttributes
+                FALSE, // bManualReset
+                FALSE, // bInitialState
+                NULL); // lpName
+        if (!g_background_reload.done)
+            exit_windows_system_error("could not create background decoding event");
+    }
+
+    DWORD WINAPI decode_background_thread(LPVOID param)
+    {
+        BackgroundReload *reload = (BackgroundReload*)param;
+        reload->error = decode_background_image(g_background_image_filename, &reload->data, &reload->image_width, &reload->image_height);
+        if (!::SetEvent(reload->done))
+            exit_windows_system_error("could not signal the end of background decoding");
+        return 0;
+    }
+
+    /**
+     * Start decoding the background image on a worker thread if it changed
+     * on disk since it was loaded.
+     */
+    void start_background_reload()
+    {
+        BackgroundReload *reload = &g_background_reload;
+        if (reload->thread) {
+            reload->pending = true;
+            return;
+        }
+        // take the time stamp first so that we do not miss a change during decoding
+        if (!get_file_write_time(g_background_image_filename, &reload->write_time)
+                || ::CompareFileTime(&reload->write_time, &g_background_image_write_time) == 0)
+            return; // another file in the directory changed
+        reload->thread = ::CreateThread(
+                NULL, // lpThreadAttributes
+                0, // dwStackSize
+                decode_background_thread, // lpStartAddress
+                reload, // lpParameter
+                0, // dwCreationFlags
+                NULL); // lpThreadId
+        if (!reload->thread)
+            exit_windows_system_error("could not create background decoding thread");
+    }
+
+    /**
+     * Call this when g_background_watch is signaled.
+     */
+    void handle_background_change()
+    {
+        if (!::FindNextChangeNotification(g_background_watch))
+            exit_windows_system_error("could not continue watching the background image");
+        start_background_reload();
+    }
+
+    /**
+     * Swap in the background image decoded by decode_background_thread.
+     * Call this when g_background_reload.done is signaled.
+     */
+    void handle_background_decoded()
+    {
+        BackgroundReload *reload = &g_background_reload;
+        if (::WaitForSingleObject(reload->thread, INFINITE) == WAIT_FAILED)
+            exit_windows_system_error("could not wait for background decoding thread");
+        (void)::CloseHandle(reload->thread);
+        reload->thread = NULL;
+
+        // if decoding failed, maybe the file is still being written; we try again on the next change
+        if (!reload->error) {
+            if (reload->image_width != g_background_image_width || reload->image_height != g_background_image_height) {
+                // the timer window keeps its size
+                free(reload->data);
+            }
+            else {
+                g_background_image_write_time = reload->write_time;
+                free(g_background_image_data);
+                g_background_image_data = reload->data;
+
+                if (g_countdown_surface.dc) {
+                    RECT dirty;
+                    fill_countdown_background();
+                    (void)update_countdown_surface(&dirty);
+                }
+                if (!::InvalidateRect(g_main_window, NULL, FALSE))
+                    exit_windows_system_error("InvalidateRect failed");
+                publish_shared_frame();
+            }
+        }
+        reload->data = nullptr;
+
+        if (reload->pending) {
+            reload->pending = false;
+            start_background_reload();
+        }
+    }
+
+    typedef void EventHandlerFn();
+
+    /**
+     * The main loop waits for all event sources at once and sleeps until
+     * the next one is signaled, so there is no polling and timers expire
+     * exactly at their deadlines. Sources are serviced in the order they
+     * were added because MsgWaitForMultipleObjectsEx reports the signaled
+     * handle with the lowest index, so add paint-critical sources first.
+     * Queued window messages are dispatched after every handler, so WM_PAINT
+     * never waits for more than one lower-priority handler.
+     */
+    struct EventLoop {
+        HANDLE handles[MAXIMUM_WAIT_OBJECTS - 1]; // one slot is taken by the message queue
+        EventHandlerFn *handlers[MAXIMUM_WAIT_OBJECTS - 1];
+        DWORD n_handles;
+    };
+
+    EventLoop g_event_loop;
+
+    void add_event_source(HANDLE handle, EventHandlerFn *handler)
+    {
+        EventLoop *loop = &g_event_loop;
+        assert(loop->n_handles < MAXIMUM_WAIT_OBJECTS - 1);
+        loop->handles[loop->n_handles] = handle;
+        loop->handlers[loop->n_handles] = handler;
+        loop->n_handles++;
+    }
+
+    /**
+     * Dispatch all queued window messages (including WM_PAINT, which is
+     * only generated once the queue is otherwise empty).
+     *
+     * \return false if WM_QUIT was received, in which case *exit_code is set.
+     */
+    bool dispatch_queued_messages(int *exit_code)
+    {
+        MSG msg;
+        while (::PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) {
+                *exit_code = (int)msg.wParam;
+                return false;
+            }
+            (void)::DispatchMessage(&msg);
+        }
+        return true;
+    }
+
+    /**
+     * \return the exit code passed to PostQuitMessage.
+     */
+    int run_event_loop()
     {
-        ::GetLocalTime(&g_expiry_time);
-        g_expiry_time.wMinute += g_countdown_minutes;
-        g_expiry_time.wHour += g_expiry_time.wMinute / 60;
-        g_expiry_time.wMinute %= 60;
+        EventLoop *loop = &g_event_loop;
+        int exit_code = 0;
+        while (true) {
+            DWORD result = ::MsgWaitForMultipleObjectsEx(
+                    loop->n_handles, // nCount
+                    loop->handles, // pHandles
+                    INFINITE, // dwMilliseconds
+                    QS_ALLINPUT, // dwWakeMask
+                    MWMO_INPUTAVAILABLE); // dwFlags (also wake up for messages that are already queued)
+            if (result < WAIT_OBJECT_0 + loop->n_handles)
+                loop->handlers[result - WAIT_OBJECT_0]();
+            else if (result != WAIT_OBJECT_0 + loop->n_handles)
+                exit_windows_system_error("waiting for events failed");
+            // a busy handle with a lower index than the message queue must not starve painting
+            if (!dispatch_queued_messages(&exit_code))
+                return exit_code;
+        }
     }
 }
 
@@ -855,23 +3654,6 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             else
                 paint_marker_window(hWnd);
             break;
-        case WM_TIMER:
-            {
-                SYSTEMTIME remaining;
-                if (calculate_time_until_expiry(&remaining)) {
-                    // set the next timer expiry right after the second flips
-                    UINT elapse = max(USER_TIMER_MINIMUM, remaining.wMilliseconds + 1);
-#ifdef DEBUG_MEMORY_USE
-                    elapse = USER_TIMER_MINIMUM; // stress the paint function
-#endif
-                    UINT_PTR timer = ::SetTimer(hWnd, wParam, elapse, NULL);
-                    if (!timer)
-                        exit_windows_system_error("could not re-set update timer");
-                }
-                if (!::InvalidateRect(hWnd, NULL, FALSE))
-                    exit_windows_system_error("InvalidateRect failed");
-            }
-            break;
         default:
             return ::DefWindowProc(hWnd, message, wParam, lParam);
     }
@@ -899,30 +3681,67 @@ void prevent_windows_dpi_scaling()
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
     parse_command_line(lpCmdLine);
-    set_expiry_time();
+    if (g_analyze_path)
+        return run_batch_analysis();
+    reset_clock();
+    // before the overlays are clipped to the monitors, which must be given in physical pixels
+    prevent_windows_dpi_scaling();
+#ifdef OVERHEAD_EMBEDDED_ASSETS
+    use_embedded_assets();
+#else
     load_background_image();
-    load_overlay_image_and_determine_marker_lines();
+    load_overlay_images_and_determine_marker_lines();
+#endif
 
-    prevent_windows_dpi_scaling();
+    if (g_emit_assets_filename) {
+        emit_embedded_assets();
+        return 0;
+    }
+
+    if (g_soak_frames) {
+        create_font();
+        create_countdown_surface();
+        create_shared_frame_output();
+        return run_soak_test();
+    }
+
+    report_outline_simplification();
     ATOM window_class = register_window_class(hInstance, WndProc);
     create_main_window(hInstance, window_class);
     create_marker_windows(hInstance, window_class);
     create_font();
+    create_countdown_surface();
+    {
+        RECT dirty;
+        (void)update_countdown_surface(&dirty); // the window is painted completely anyway
+    }
+    create_shared_frame_output();
+    publish_shared_frame();
+
+    create_timers();
+    create_control_pipe();
+    create_background_watch();
+
+    // in order of priority (see EventLoop)
+    add_event_source(g_clock_timer, handle_clock_timer);
+    add_event_source(g_animation_timer, advance_animations);
+    if (g_control_pipe_name)
+        add_event_source(g_control.event, service_control_pipe);
+    if (g_background_watch != INVALID_HANDLE_VALUE) {
+        add_event_source(g_background_reload.done, handle_background_decoded);
+        add_event_source(g_background_watch, handle_background_change);
+    }
+
+    start_animations();
 
     if (g_countdown_minutes) {
         // start the update timer for the countdown window
-        UINT_PTR timer = ::SetTimer(g_main_window, 0, USER_TIMER_MINIMUM, NULL);
-        if (!timer)
-            exit_windows_system_error("could not set update timer");
+        start_clock_timer();
     }
 
 #ifdef DEBUG_MEMORY_USE
     open_console_window();
 #endif
 
-    MSG msg = {0};
-    while (::GetMessage(&msg, NULL, 0, 0))
-        (void)::DispatchMessage(&msg);
-
-    return 0;
+    return run_event_loop();
 }
@@ -0,0 +1,65 @@
+/* overhead_shm.h - layout of the shared memory frame output of 'overhead'.
+
+   When 'overhead' is started with --shm[=NAME], it creates the named file
+   mapping "Local\NAME" (default: "Local\overhead_frames") and publishes every
+   rendered countdown frame into it, so that a local consumer (for example a
+   source plugin of your streaming software) can read the frames without any
+   screen capture. See overhead_shm_reader.cpp for a reference reader.
+
+   The mapping is laid out as follows:
+
+       OverheadShmHeader
+       OverheadShmMarker[n_markers]  (at marker_offset)
+       n_slots frame slots           (at slot_offset, slot_size bytes apart)
+
+   Each frame slot starts with an OverheadShmSlot followed by the pixels
+   (height rows of stride bytes, top-down, 32 bits per pixel as B, G, R, X).
+
+   Frames are published with a sequence lock: the writer sets the sequence
+   number of the slot to 0, writes the pixels, then stores the frame's
+   sequence number in the slot and finally in latest_sequence. Readers take
+   latest_sequence, copy slot (latest_sequence % n_slots) and accept the copy
+   if the slot's sequence number was equal to latest_sequence both before and
+   after copying. With several slots, a reader has n_slots - 1 frame periods
+   to finish its copy.
+
+   This file is released into the public domain (see overhead.cpp).
+*/
+
+#ifndef OVERHEAD_SHM_H
+#define OVERHEAD_SHM_H
+
+#include <cstdint>
+
+#define OVERHEAD_SHM_MAGIC 0x5246484Fu // "OHFR" in little-endian
+#define OVERHEAD_SHM_VERSION 1
+#define OVERHEAD_SHM_DEFAULT_NAME "overhead_frames"
+
+struct OverheadShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride; // bytes per pixel row
+    uint32_t n_slots;
+    uint32_t slot_offset; // from the start of the mapping
+    uint32_t slot_size; // including the OverheadShmSlot header
+    uint32_t marker_offset; // from the start of the mapping
+    uint32_t n_markers;
+    volatile uint64_t latest_sequence; // 0 until the first frame is published
+};
+
+// marker rectangle of a static overlay in screen coordinates (see --overlay in overhead.cpp)
+struct OverheadShmMarker {
+    int32_t x;
+    int32_t y;
+    int32_t w;
+    int32_t h;
+};
+
+struct OverheadShmSlot {
+    volatile uint64_t sequence; // 0 while the slot is being written
+    uint64_t reserved;
+};
+
+#endif // OVERHEAD_SHM_H
@@ -0,0 +1,130 @@
+/* overhead_shm_reader - reference reader for the shared memory frame output
+   of 'overhead' (see --shm in overhead.cpp and the layout in overhead_shm.h).
+
+   Usage: overhead_shm_reader [--name=NAME] [--dump=FILE.ppm]
+
+   Without --dump, the program prints a line for every new frame it reads.
+   With --dump, it writes the first frame it reads to FILE.ppm and exits.
+
+   This file is released into the public domain (see overhead.cpp).
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cinttypes>
+
+#include <windows.h>
+
+#include "overhead_shm.h"
+
+namespace {
+    void exit_error(char *fmt, ...)
+    {
+        va_list vl;
+        va_start(vl, fmt);
+        fprintf(stderr, "error: ");
+        vfprintf(stderr, fmt, vl);
+        va_end(vl);
+        exit(EXIT_FAILURE);
+    }
+
+    /**
+     * Copy the latest frame into pixels (which must have room for stride * height bytes).
+     *
+     * \return the sequence number of the copied frame or 0 if there was no
+     *         consistent frame to copy.
+     */
+    uint64_t copy_latest_frame(uint8_t *view, uint8_t *pixels)
+    {
+        OverheadShmHeader *header = (OverheadShmHeader*)view;
+        uint64_t sequence = header->latest_sequence;
+        if (!sequence)
+            return 0;
+        OverheadShmSlot *slot = (OverheadShmSlot*)(view + header->slot_offset
+                + (sequence % header->n_slots) * header->slot_size);
+        if (slot->sequence != sequence)
+            return 0;
+        ::MemoryBarrier();
+        memcpy(pixels, slot + 1, (size_t)header->stride * header->height);
+        ::MemoryBarrier();
+        // the writer may have reused the slot while we were copying
+        if (slot->sequence != sequence)
+            return 0;
+        return sequence;
+    }
+
+    void write_ppm(char *filename, OverheadShmHeader *header, uint8_t *pixels)
+    {
+        #pragma warning (suppress : 4996) // no need for fopen_s
+        FILE *file = fopen(filename, "wb");
+        if (!file)
+            exit_error("could not open '%s' for writing\n", filename);
+        fprintf(file, "P6\n%u %u\n255\n", header->width, header->height);
+        for (uint32_t y = 0; y < header->height; ++y)
+            for (uint32_t x = 0; x < header->width; ++x) {
+                uint8_t *pixel = pixels + (size_t)header->stride * y + 4 * x;
+                uint8_t rgb[3] = { pixel[2], pixel[1], pixel[0] };
+                fwrite(rgb, 1, 3, file);
+            }
+        if (fclose(file) != 0)
+            exit_error("could not write '%s'\n", filename);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char *name = OVERHEAD_SHM_DEFAULT_NAME;
+    char *dump_filename = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--name=", 7) == 0)
+            name = argv[i] + 7;
+        else if (strncmp(argv[i], "--dump=", 7) == 0)
+            dump_filename = argv[i] + 7;
+        else
+            exit_error("unexpected argument: %s\n\nUsage: overhead_shm_reader [--name=NAME] [--dump=FILE.ppm]\n", argv[i]);
+    }
+
+    char mapping_name[MAX_PATH];
+    int result = snprintf(mapping_name, sizeof(mapping_name), "Local\\%s", name);
+    if (result < 0 || (size_t)result >= sizeof(mapping_name))
+        exit_error("shared memory name is too long: %s\n", name);
+    HANDLE mapping = ::OpenFileMapping(FILE_MAP_READ, FALSE, mapping_name);
+    if (!mapping)
+        exit_error("could not open shared memory '%s' (is overhead running with --shm?)\n", mapping_name);
+    uint8_t *view = (uint8_t*)::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+        exit_error("could not map shared memory '%s'\n", mapping_name);
+
+    OverheadShmHeader *header = (OverheadShmHeader*)view;
+    if (header->magic != OVERHEAD_SHM_MAGIC || header->version != OVERHEAD_SHM_VERSION)
+        exit_error("shared memory '%s' has an unexpected format\n", mapping_name);
+    ::MemoryBarrier();
+    printf("%s: %u x %u pixels, stride %u, %u slots, %u markers\n", mapping_name,
+            header->width, header->height, header->stride, header->n_slots, header->n_markers);
+
+    uint8_t *pixels = (uint8_t*)malloc((size_t)header->stride * header->height);
+    if (!pixels)
+        exit_error("out of memory: could not allocate frame buffer\n");
+    uint64_t last_sequence = 0;
+    while (true) {
+        uint64_t sequence = copy_latest_frame(view, pixels);
+        if (sequence && sequence != last_sequence) {
+            if (dump_filename) {
+                write_ppm(dump_filename, header, pixels);
+                printf("wrote frame %" PRIu64 " to '%s'\n", sequence, dump_filename);
+                break;
+            }
+            printf("frame %" PRIu64 "\n", sequence);
+            fflush(stdout);
+            last_sequence = sequence;
+        }
+        ::Sleep(5);
+    }
+
+    free(pixels);
+    (void)::UnmapViewOfFile(view);
+    (void)::CloseHandle(mapping);
+    return 0;
+}